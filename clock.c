@@ -1,5 +1,5 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
  *           Alpha, and Sparc boxes.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
@@ -9,14 +9,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
 
 /******************************************************* 
  * Machine dependent functions 
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __i386__, __x86_64__ and __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
@@ -71,6 +76,98 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *
+ * The time stamp counter is read with lfence on both sides at the
+ * start, so that neither earlier instructions nor the timed code run
+ * across the read, and with rdtscp followed by lfence at the end,
+ * which waits for the timed code and keeps later instructions out.
+ * rdtscp is replaced by lfence; rdtsc on the rare CPUs without it.
+ *******************************************************/
+
+static unsigned long long cyc_start = 0;
+static int has_rdtscp = -1;  /* -1 until checked with cpuid */
+
+static unsigned long long read_tsc_start(void)
+{
+    unsigned lo, hi;
+
+    asm volatile("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+static unsigned long long read_tsc_end(void)
+{
+    unsigned lo, hi, aux;
+
+    if (has_rdtscp)
+	asm volatile("rdtscp; lfence" 
+		     : "=a" (lo), "=d" (hi), "=c" (aux) : : "memory");
+    else
+	asm volatile("lfence; rdtsc; lfence" 
+		     : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (has_rdtscp < 0)
+	has_rdtscp = __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && 
+	    (edx & (1u << 27));
+    cyc_start = read_tsc_start();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(read_tsc_end() - cyc_start);
+}
+
+/*
+ * tsc_mhz - Rate of the time stamp counter, calibrated against
+ *    CLOCK_MONOTONIC_RAW over TSC_CALIBRATION_NS. Returns 0 unless the
+ *    CPU has an invariant TSC, i.e. one that ticks at a constant rate
+ *    in every P- and C-state, so that TSC ticks are time, not cycles.
+ */
+#define TSC_CALIBRATION_NS 100000000  /* 100 ms */
+
+static double clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return 1e9 * ts.tv_sec + ts.tv_nsec;
+}
+
+double tsc_mhz(void)
+{
+    unsigned eax, ebx, ecx, edx;
+    unsigned long long c0, c1;
+    double t0, t1;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || 
+	!(edx & (1u << 8)))
+	return 0;
+
+    /* Each clock read is bracketed by TSC reads, and paired with their
+       midpoint */
+    c0 = read_tsc_start();
+    t0 = clock_ns();
+    c0 = (c0 + read_tsc_start()) / 2;
+    do {
+	c1 = read_tsc_start();
+	t1 = clock_ns();
+	c1 = (c1 + read_tsc_start()) / 2;
+    } while (t1 - t0 < TSC_CALIBRATION_NS);
+
+    return (double)(c1 - c0) / ((t1 - t0) / 1e3);
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -160,6 +257,14 @@ double get_counter()
 }
 #endif
 
+#if !defined(__x86_64__)
+/* No calibrated time stamp counter on the other platforms */
+double tsc_mhz(void)
+{
+    return 0;
+}
+#endif
+
 
 
 
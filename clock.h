@@ -15,6 +15,10 @@ double mhz(int verbose);
 /* Determine clock rate of processor, having more control over accuracy */
 double mhz_full(int verbose, int sleeptime);
 
+/* Rate of the invariant time stamp counter (x86-64), calibrated against
+   CLOCK_MONOTONIC_RAW, or 0 if there is none */
+double tsc_mhz(void);
+
 /** Special counters that compensate for timer interrupt overhead */
 
 void start_comp_counter();
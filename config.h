@@ -58,7 +58,8 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Default maximum heap size in bytes. The heap is only reserved address
+ * space; mdriver -H or the MEM_HEAP_SIZE environment variable override it.
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
@@ -67,6 +68,8 @@
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_TSC    1   /* invariant TSC (x86-64), else USE_CLOCK */
+#define USE_CLOCK  0   /* clock_gettime(CLOCK_MONOTONIC_RAW) (POSIX) */
 
 #endif /* __CONFIG_H */
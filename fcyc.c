@@ -8,6 +8,7 @@
  * the time in CPU cycles for a function f.
  */
 #include <stdlib.h>
+#include <string.h>
 #include <sys/times.h>
 #include <stdio.h>
 
@@ -98,7 +99,8 @@ static int has_converged()
 }
 
 /* 
- * clear - Code to clear cache 
+ * clear - Code to clear cache. The buffer is written once, since the
+ * untouched pages of a fresh buffer all map the same zero page.
  */
 static volatile int sink = 0;
 
@@ -113,6 +115,7 @@ static void clear()
 	    fprintf(stderr, "Fatal error.  Malloc returned null when trying to clear cache\n");
 	    exit(1);
 	}
+	memset(cache_buf, 1, cache_bytes);
     }
     cptr = (int *) cache_buf;
     cend = cptr + cache_bytes/sizeof(int);
@@ -123,6 +126,57 @@ static void clear()
     sink = x;
 }
 
+/*
+ * fcyc_clear_cache - Evict the caches with the buffer of clear(), as
+ *     fcyc does before each measurement when set_fcyc_clear_cache is set
+ */
+void fcyc_clear_cache(void)
+{
+    clear();
+}
+
+/*
+ * fcyc_llc_size - Size in bytes of the last level data or unified cache
+ *     of CPU 0, read from sysfs, or the default cache size if unknown
+ */
+int fcyc_llc_size(void)
+{
+    char path[128], type[32];
+    FILE *fp;
+    int i, level, size, best_level = 0, best_size = CACHE_BYTES;
+    char unit;
+
+    for (i = 0; i < 16; i++) {
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    break;
+	level = (fscanf(fp, "%d", &level) == 1) ? level : 0;
+	fclose(fp);
+
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    continue;
+	if (fscanf(fp, "%31s", type) != 1 || strcmp(type, "Instruction") == 0)
+	    level = 0;
+	fclose(fp);
+
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+	if (level <= best_level || (fp = fopen(path, "r")) == NULL)
+	    continue;
+	unit = ' ';
+	if (fscanf(fp, "%d%c", &size, &unit) >= 1 && size > 0) {
+	    if (unit == 'K')
+		size <<= 10;
+	    else if (unit == 'M')
+		size <<= 20;
+	    best_level = level;
+	    best_size = size;
+	}
+	fclose(fp);
+    }
+    return best_size;
+}
+
 /*
  * fcyc - Use K-best scheme to estimate the running time of function f
  */
@@ -63,6 +63,18 @@ void set_fcyc_maxsamples(int maxsamples_arg);
  */
 void set_fcyc_epsilon(double epsilon_arg);
 
+/* 
+ * fcyc_clear_cache - Clear the cache as fcyc does before each 
+ *     measurement, with a buffer of the size set by set_fcyc_cache_size
+ */
+void fcyc_clear_cache(void);
+
+/* 
+ * fcyc_llc_size - Size in bytes of the last level cache (from sysfs 
+ *     on Linux), or the default cache size if unknown
+ */
+int fcyc_llc_size(void);
+
 
 
 
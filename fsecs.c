@@ -2,6 +2,7 @@
  * High-level timing wrappers
  ****************************/
 #include <stdio.h>
+#include <limits.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -9,6 +10,7 @@
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static int cold;    /* evict the caches before each run of f? */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -25,11 +27,22 @@ void init_fsecs(void)
 
     /* set key parameters for the fcyc package */
     set_fcyc_maxsamples(20); 
-    set_fcyc_clear_cache(1);
+    set_fcyc_clear_cache(cold);
     set_fcyc_compensate(1);
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
-    Mhz = mhz(verbose > 0);
+    if ((Mhz = tsc_mhz()) == 0)
+	Mhz = mhz(verbose > 0);
+#elif USE_TSC
+    Mhz = tsc_mhz();
+    if (verbose && Mhz > 0)
+	printf("Measuring performance with the TSC (%.1f MHz).\n", Mhz);
+    else if (verbose)
+	printf("No invariant TSC: measuring performance with "
+	       "clock_gettime().\n");
+#elif USE_CLOCK
+    if (verbose)
+	printf("Measuring performance with clock_gettime().\n");
 #elif USE_ITIMER
     if (verbose)
 	printf("Measuring performance with the interval timer.\n");
@@ -39,19 +52,82 @@ void init_fsecs(void)
 #endif
 }
 
+/*
+ * fsecs_method - Name of the timing method, for the result files
+ */
+const char *fsecs_method(void)
+{
+#if USE_FCYC
+    return "fcyc";
+#elif USE_TSC
+    return (Mhz > 0) ? "tsc" : "clock_gettime";
+#elif USE_CLOCK
+    return "clock_gettime";
+#elif USE_ITIMER
+    return "itimer";
+#elif USE_GETTOD
+    return "gettod";
+#endif
+}
+
+/*
+ * set_fsecs_cold - With cold set, fsecs evicts the caches before every
+ *    run of f, with a buffer twice the size of the last level cache, and
+ *    the eviction is not timed
+ */
+void set_fsecs_cold(int cold_arg)
+{
+    int llc = fcyc_llc_size();
+
+    cold = cold_arg;
+    if (cold) {
+	set_fcyc_cache_size(llc < INT_MAX / 2 ? 2 * llc : INT_MAX);
+	set_fcyc_cache_block(64);
+    }
+#if USE_FCYC
+    set_fcyc_clear_cache(cold);
+#endif
+}
+
+/*
+ * ftime - Return the average running time of n runs of f
+ */
+static double ftime(fsecs_test_funct f, void *argp, int n)
+{
+#if USE_ITIMER
+    return ftimer_itimer(f, argp, n);
+#elif USE_TSC
+    if (Mhz > 0)
+	return ftimer_tsc(f, argp, n, Mhz);
+    return ftimer_clock(f, argp, n);
+#elif USE_CLOCK
+    return ftimer_clock(f, argp, n);
+#elif USE_GETTOD
+    return ftimer_gettod(f, argp, n);
+#else
+    return 0;
+#endif
+}
+
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    double secs = 0;
+    int i;
+
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
-#elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
-#endif 
+#endif
+    if (!cold)
+	return ftime(f, argp, 10);
+    for (i = 0; i < 10; i++) {
+	fcyc_clear_cache();
+	secs += ftime(f, argp, 1);
+    }
+    return secs / 10;
 }
 
 
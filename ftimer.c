@@ -7,10 +7,18 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_clock: version that uses clock_gettime
+ *    ftimer_tsc: version that uses the time stamp counter
  */
 #include <stdio.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
+#include "clock.h"
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
 
 /* function prototypes */
 static void init_etime(void);
@@ -52,6 +60,41 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/* 
+ * ftimer_clock - Use clock_gettime(CLOCK_MONOTONIC_RAW), which has a
+ * nanosecond resolution and is not slewed by NTP, to estimate the
+ * running time of f(argp). Return the average of n runs.  
+ */
+double ftimer_clock(ftimer_test_funct f, void *argp, int n)
+{
+    int i;
+    struct timespec sts, ets;
+    double diff;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &sts);
+    for (i = 0; i < n; i++) 
+	f(argp);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ets);
+    diff = (ets.tv_sec - sts.tv_sec) + 1E-9*(ets.tv_nsec - sts.tv_nsec);
+    return diff / n;
+}
+
+/* 
+ * ftimer_tsc - Use the time stamp counter, which ticks at mhz MHz, to
+ * estimate the running time of f(argp). Return the average of n runs.  
+ */
+double ftimer_tsc(ftimer_test_funct f, void *argp, int n, double mhz)
+{
+    int i;
+    double cycles;
+
+    start_counter();
+    for (i = 0; i < n; i++) 
+	f(argp);
+    cycles = get_counter();
+    return cycles / (mhz * 1E6) / n;
+}
+
 
 /*
  * Routines for manipulating the Unix interval timer
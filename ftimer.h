@@ -12,3 +12,12 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Estimate the running time of f(argp) using clock_gettime 
+   (CLOCK_MONOTONIC_RAW). Return the average of n runs */
+double ftimer_clock(ftimer_test_funct f, void *argp, int n);
+
+/* Estimate the running time of f(argp) using the cycle counter of
+   clock.c, which ticks at mhz MHz (see tsc_mhz). Return the average
+   of n runs */
+double ftimer_tsc(ftimer_test_funct f, void *argp, int n, double mhz);
+
@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE       /* for sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -14,11 +15,19 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include <time.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 #include "mm.h"
+#include "mm-arena.h"
+#include "mm-pool.h"
+#include "trace.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "perfctr.h"
 #include "config.h"
 
 /**********************
@@ -29,6 +38,16 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define RANGE_CHUNK 1024 /* number of range records allocated at once */
+
+/* Repeated timings (-R, -e) and comparison with a baseline (-C) */
+#define MAX_RUNS      100   /* max number of timed runs of a trace */
+#define CI_MIN_RUNS   6     /* fewer runs give no 95% CI of the median */
+#define RUN_BUDGET    10.0  /* default time budget of the runs (secs) */
+#define CMP_ALPHA     0.05  /* family-wise level of the throughput tests */
+#define CMP_MIN_DROP  0.10  /* default of the smallest reported drop (-D) */
+#define CMP_MIN_UTIL  0.001 /* smaller utilization drops are not reported */
+#define LAT_REPLAYS   3     /* replays of the per-request timing (-L) */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
@@ -37,31 +56,19 @@
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* 
+ * Records the extent of each block's payload. The records of the live
+ * blocks form a treap: a binary search tree ordered by lo, which is also
+ * a max-heap on random priorities, so its expected depth is O(log n).
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned int prio;     /* random heap priority */
+    struct range_t *left;  /* ranges with lower addresses */
+    struct range_t *right; /* ranges with higher addresses */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -70,8 +77,41 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    int pool_max;    /* largest request served by a pool (-O) */
 } speed_t;
 
+/* 
+ * Heap bytes at the peak of a trace, by use (-F). Allocated blocks are
+ * split into the requested payload, its rounding to ALIGNMENT, the
+ * header and footer of the engine, and the rest of the block (minimum
+ * block size, unsplit remainders, size classes). Free blocks are holes,
+ * by size class, except the one at the end of the heap.
+ */
+#define FRAG_MIN_CLASS 3   /* holes of less than 2^4 bytes */
+#define FRAG_CLASSES 16    /* ..., holes of 2^18 bytes or more */
+typedef struct {
+    size_t heap;       /* heap size, 0 if not broken down */
+    size_t payload;    /* requested bytes */
+    size_t align;      /* rounding of the requests to ALIGNMENT */
+    size_t header;     /* headers and footers of the allocated blocks */
+    size_t padding;    /* rest of the allocated blocks */
+    size_t holes[FRAG_CLASSES]; /* free blocks but the last, by class */
+    size_t tail;       /* free block at the end of the heap */
+    size_t meta;       /* metadata of the engine */
+} frag_t;
+
+/* 
+ * Latency of the requests of a trace, in ns (-L): every request keeps
+ * its fastest time over LAT_REPLAYS replays
+ */
+typedef struct {
+    double p50, p99, p999; /* percentiles of the requests */
+    double max;            /* slowest request */
+    int worst_op;          /* its index in the trace, -1 if not measured */
+    int worst_type;        /* and its type and size */
+    int worst_size;
+} lat_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -81,10 +121,29 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double rss_util; /* same, relative to the resident heap pages */
+    frag_t frag;     /* heap at the peak of the trace (-F) */
+    int runs;        /* number of timed runs (-R) */
+    double run_secs[MAX_RUNS]; /* secs of each run; secs is their median */
+    double ref_secs[MAX_RUNS]; /* libc replay after each run (-o, -C) */
+    double mad;      /* median absolute deviation of the runs */
+    double ci_lo, ci_hi; /* 95% confidence interval of the median */
+    double cold_secs;    /* same as secs, with cold caches (-W) */
+    int cold_runs;       /* number of cold runs... */
+    double cold_ci_lo, cold_ci_hi; /* ... and the 95% CI of their median */
+    double counters[PC_NB_EVENTS]; /* hardware events of a run (-c) */
+    lat_t lat;       /* per-request latency (-L) */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* Result of one trace, sent by a worker process of the -j mode */
+typedef struct {
+    int tracenum;    /* index of the trace in the tracefiles array */
+    int errors;      /* number of errors found on this trace */
+    stats_t stats;
+} result_t;
+
 /********************
  * Global variables
  *******************/
@@ -92,9 +151,45 @@ int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
+/* Reads a trace: read_trace, or stream_trace with -s */
+static trace_t *(*load_trace)(char *, char *) = read_trace;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Unused range records, linked through their right pointers */
+static range_t *free_ranges = NULL;
+
+/* Heap samples of eval_mm_util (-u): interval in ops, and CSV file */
+static int util_interval = 0;
+static char *util_file = "util.csv";
+static FILE *util_csv = NULL;
+
+/* Break down the heap at the peak of every trace (-F) */
+static int frag_flag = 0;
+
+/* Timed runs per trace (-R), result file (-o) and baseline (-C) */
+static int num_runs = 1;
+
+/* Runner: warmup replays (-w), target relative half-width of the 95% CI
+   (-e), time budget of the runs of a trace (-b) and CPU (-k) */
+static int num_warmup = 1;
+static double ci_target = 0;
+static double run_budget = RUN_BUDGET;
+static int pin_cpu = -1;
+
+/* Time the traces with cold caches as well (-W) */
+static int cold_flag = 0;
+static char *results_file = NULL;
+static char *baseline_file = NULL;
+static double min_drop = CMP_MIN_DROP;
+
+/* Count hardware events during a run of every trace (-c) */
+static int counters_flag = 0;
+
+/* Time every request on its own (-L) */
+static int latency_flag = 0;
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -105,15 +200,15 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
-
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
+static range_t *new_range(void);
+static void free_range(range_t *p);
+static void split_ranges(range_t *t, char *lo, range_t **left, range_t **right);
+static range_t *merge_ranges(range_t *left, range_t *right);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -122,11 +217,46 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   int *peak_op);
+static void eval_mm_frag(trace_t *trace, int peak_op, frag_t *frag);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, lat_t *lat);
+static void time_mm_trace(trace_t *trace, stats_t *stats);
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats, 
+			  int timed);
+static void eval_mm_parallel(char **tracefiles, int num_tracefiles, 
+			     stats_t *stats, int num_jobs, int timed);
+
+/* Routines for replaying a trace with one arena per phase (-A) */
+static void annotate_phases(trace_t *trace, int phase_len);
+static double eval_arena_util(trace_t *trace);
+static void eval_arena_speed(void *ptr);
+static int arena_replay(trace_t *trace, int touch);
+
+/* Routines for replaying a trace with object pools (-O) */
+static int pool_replay(trace_t *trace, int pool_max, int tracenum,
+		       range_t **ranges, int touch, mm_stats_t *pstats);
+static double eval_pool_util(trace_t *trace, int pool_max, mm_stats_t *pstats);
+static void eval_pool_speed(void *ptr);
+static void printpoolstats(int tracenum, mm_stats_t *st);
 
 /* Various helper routines */
+static void touch_payload(char *p, int size);
+static void sample_heap(int tracenum, int op, int live_bytes);
+static double resident_util(double util);
 static void printresults(int n, stats_t *stats);
+static void printheapstats(void);
+static void printfrag(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printruns(int n, stats_t *stats);
+static void printcold(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void write_results(char *file, int argc, char **argv, 
+			  char **tracefiles, int n, stats_t *stats, 
+			  double perfindex);
+static int compare_results(char *file, char **tracefiles, int n, 
+			   stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -142,23 +272,32 @@ int main(int argc, char **argv)
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t *arena_stats = NULL; /* phase arena stats for each trace */
+    stats_t *pool_stats = NULL;  /* object pool stats for each trace */
+    range_t *pool_ranges = NULL; /* payloads of the pool replay */
+    mm_stats_t pool_heap;        /* pools at the peak of a trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int phase_len = 0;   /* If set, replay traces with phase arenas (-A) */
+    int pool_max = 0;    /* If set, replay traces with object pools (-O) */
+    int num_jobs = 1;    /* number of worker processes (-j) */
+    int timed_jobs = 0;  /* If set, time the traces in the workers (-P) */
+    size_t size;         /* heap size given with -H */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
     int numcorrect;
+    int status = 0;      /* exit status, 2 if the baseline check fails */
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgalscFPWLA:O:H:T:S:j:u:U:R:o:C:w:e:b:k:D:")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,12 +323,125 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 's': /* Stream the traces instead of loading them */
+            load_trace = stream_trace;
+            break;
+        case 'j': /* Evaluate the traces in parallel worker processes */
+            num_jobs = atoi(optarg);
+            if (num_jobs <= 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'P': /* Time the traces in the workers as well */
+            timed_jobs = 1;
+            break;
+        case 'A': /* Replay traces with phase arenas of the given length */
+            phase_len = atoi(optarg);
+            if (phase_len <= 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'O': /* Replay traces with pools for requests up to n bytes */
+            pool_max = atoi(optarg);
+            if (pool_max <= 0) {
+		usage();
+		exit(1);
+	    }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
         case 'V': /* Be more verbose than -v */
             verbose = 2;
             break;
+        case 'H': /* Size of the simulated heap */
+            if ((size = mem_parse_size(optarg)) == 0) {
+		usage();
+		exit(1);
+	    }
+	    mem_set_max_heap(size);
+            break;
+        case 'T': /* Huge page policy of the simulated heap */
+	    mem_set_hugepages(atoi(optarg));
+            break;
+        case 'S': /* Cost model of mem_sbrk */
+	    if (mem_set_cost_model(optarg) < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'u': /* Sample the heap every <n> ops */
+            util_interval = atoi(optarg);
+            if (util_interval <= 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'U': /* CSV file of the heap samples */
+            util_file = optarg;
+            break;
+        case 'c': /* Count hardware events during the timed runs */
+            counters_flag = 1;
+            break;
+        case 'F': /* Break down the heap at the peak of every trace */
+            frag_flag = 1;
+            break;
+        case 'R': /* Time every trace <n> times */
+            num_runs = atoi(optarg);
+            if (num_runs <= 0 || num_runs > MAX_RUNS) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'w': /* Untimed replays before the runs of a trace */
+            num_warmup = atoi(optarg);
+            if (num_warmup < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'e': /* Repeat the runs until the 95% CI is within <pct>% */
+            ci_target = atof(optarg) / 100;
+            if (ci_target <= 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'b': /* Time budget of the runs of a trace */
+            run_budget = atof(optarg);
+            if (run_budget <= 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'W': /* Time the traces with warm and cold caches */
+            cold_flag = 1;
+            break;
+        case 'L': /* Time every request on its own */
+            latency_flag = 1;
+            break;
+        case 'k': /* Pin the driver to a CPU */
+            pin_cpu = atoi(optarg);
+            if (pin_cpu < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'o': /* Write the results to a JSON or CSV file */
+            results_file = optarg;
+            break;
+        case 'C': /* Compare the results with a baseline file */
+            baseline_file = optarg;
+            break;
+        case 'D': /* Smallest throughput drop flagged by -C */
+            min_drop = atof(optarg) / 100;
+            if (min_drop <= 0) {
+		usage();
+		exit(1);
+	    }
+            break;
         case 'h': /* Print this message */
 	    usage();
             exit(0);
@@ -198,6 +450,31 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
+    if (phase_len > 0 && load_trace == stream_trace) {
+	printf("ERROR: the arena replay (-A) needs loaded traces, not -s\n");
+	exit(1);
+    }
+    if (pool_max > 0 && load_trace == stream_trace) {
+	printf("ERROR: the pool replay (-O) needs loaded traces, not -s\n");
+	exit(1);
+    }
+    if (util_interval > 0 && num_jobs > 1) {
+	printf("ERROR: the heap samples (-u) are taken in a single process, "
+	       "not with -j\n");
+	exit(1);
+    }
+    if (pin_cpu >= 0) {
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(pin_cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+	    unix_error("Could not pin the driver (-k)");
+    }
+    if (util_interval > 0 && (util_csv = fopen(util_file, "w")) == NULL) {
+	sprintf(msg, "Could not open %s", util_file);
+	unix_error(msg);
+    }
 	
     /* 
      * Check and print team info 
@@ -252,7 +529,7 @@ int main(int argc, char **argv)
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
 	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
+	    trace = load_trace(tracedir, tracefiles[i]);
 	    libc_stats[i].ops = trace->num_ops;
 	    if (verbose > 1)
 		printf("Checking libc malloc for correctness, ");
@@ -288,23 +565,12 @@ int main(int argc, char **argv)
     mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
+    if (num_jobs > 1)
+	eval_mm_parallel(tracefiles, num_tracefiles, mm_stats, 
+			 num_jobs, timed_jobs);
+    else {
+	for (i=0; i < num_tracefiles; i++)
+	    eval_mm_trace(tracefiles[i], i, &mm_stats[i], 1);
     }
 
     /* Display the mm results in a compact table */
@@ -313,6 +579,102 @@ int main(int argc, char **argv)
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
     }
+    if (frag_flag)
+	printfrag(num_tracefiles, mm_stats);
+    if (counters_flag)
+	printcounters(num_tracefiles, mm_stats);
+    if (verbose && (num_runs > 1 || ci_target > 0))
+	printruns(num_tracefiles, mm_stats);
+    if (cold_flag)
+	printcold(num_tracefiles, mm_stats);
+    if (latency_flag)
+	printlatency(num_tracefiles, mm_stats);
+
+    /*
+     * Optionally replay the traces with phase arenas: the trace is cut
+     * into phases of phase_len ops, every block is bump-allocated in the
+     * arena of the phase in which it dies, frees are ignored, and each
+     * arena is reset at the end of its phase.
+     */
+    if (phase_len > 0) {
+	if (verbose > 1)
+	    printf("\nTesting mm arenas\n");
+
+	arena_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (arena_stats == NULL)
+	    unix_error("arena_stats calloc in main failed");
+
+	for (i=0; i < num_tracefiles; i++) {
+	    arena_stats[i].ops = mm_stats[i].ops;
+	    arena_stats[i].valid = mm_stats[i].valid;
+	    if (!arena_stats[i].valid)
+		continue;
+	    trace = load_trace(tracedir, tracefiles[i]);
+	    annotate_phases(trace, phase_len);
+	    arena_stats[i].util = eval_arena_util(trace);
+	    if (arena_stats[i].util < 0) {
+		printf("Trace %d: arena replay ran out of memory\n", i);
+		arena_stats[i].valid = 0;
+	    }
+	    else {
+		arena_stats[i].rss_util = resident_util(arena_stats[i].util);
+		speed_params.trace = trace;
+		arena_stats[i].secs = fsecs(eval_arena_speed, &speed_params);
+	    }
+	    free_trace(trace);
+	}
+
+	printf("\nResults for mm arenas:\n");
+	printresults(num_tracefiles, arena_stats);
+	printf("\n");
+    }
+
+    /*
+     * Optionally replay the traces with object pools: every request of
+     * at most pool_max bytes whose block is never reallocated comes from
+     * the pool of its size class. The payloads are checked in a first
+     * replay, as in eval_mm_valid.
+     */
+    if (pool_max > 0) {
+	if (verbose > 1)
+	    printf("\nTesting mm pools\n");
+
+	pool_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (pool_stats == NULL)
+	    unix_error("pool_stats calloc in main failed");
+
+	for (i=0; i < num_tracefiles; i++) {
+	    pool_stats[i].ops = mm_stats[i].ops;
+	    pool_stats[i].valid = mm_stats[i].valid;
+	    if (!pool_stats[i].valid)
+		continue;
+	    trace = load_trace(tracedir, tracefiles[i]);
+	    if (pool_replay(trace, pool_max, i, &pool_ranges, 0, NULL) < 0) {
+		pool_stats[i].valid = 0;
+		free_trace(trace);
+		continue;
+	    }
+	    pool_stats[i].util = eval_pool_util(trace, pool_max, &pool_heap);
+	    if (pool_stats[i].util < 0) {
+		printf("Trace %d: pool replay ran out of memory\n", i);
+		pool_stats[i].valid = 0;
+	    }
+	    else {
+		pool_stats[i].rss_util = resident_util(pool_stats[i].util);
+		if (verbose > 1)
+		    printpoolstats(i, &pool_heap);
+		speed_params.trace = trace;
+		speed_params.pool_max = pool_max;
+		pool_stats[i].secs = fsecs(eval_pool_speed, &speed_params);
+	    }
+	    free_trace(trace);
+	}
+	clear_ranges(&pool_ranges);
+
+	printf("\nResults for mm pools:\n");
+	printresults(num_tracefiles, pool_stats);
+	printf("\n");
+    }
 
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
@@ -362,27 +724,38 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    if (results_file != NULL)
+	write_results(results_file, argc, argv, tracefiles, num_tracefiles,
+		      mm_stats, perfindex);
+    if (baseline_file != NULL &&
+	compare_results(baseline_file, tracefiles, num_tracefiles, 
+			mm_stats) > 0)
+	status = 2;
+
+    if (util_csv != NULL)
+	fclose(util_csv);
+    exit(status);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and insert it in the range tree.
  */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *left, *right;
+    range_t *pred = NULL, *succ = NULL;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -404,27 +777,35 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* The payload must not overlap its neighbours in address order */
+    for (p = *ranges;  p != NULL; ) {
+	if (p->lo <= lo) {
+	    pred = p;
+	    p = p->right;
+	}
+	else {
+	    succ = p;
+	    p = p->left;
+	}
+    }
+    p = (pred != NULL && pred->hi >= lo) ? pred : 
+	(succ != NULL && succ->lo <= hi) ? succ : NULL;
+    if (p != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by inserting a range record in the tree.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = new_range();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    split_ranges(*ranges, lo, &left, &right);
+    *ranges = merge_ranges(merge_ranges(left, p), right);
     return 1;
 }
 
@@ -433,19 +814,13 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
+    range_t *left, *mid, *right;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    split_ranges(*ranges, lo, &left, &right);
+    split_ranges(right, lo + 1, &mid, &right);
+    if (mid != NULL)
+	free_range(mid);
+    *ranges = merge_ranges(left, right);
 }
 
 /*
@@ -453,119 +828,98 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free_range(p);
     *ranges = NULL;
 }
 
+/*
+ * new_range - take a range record from the pool, which is refilled
+ *    RANGE_CHUNK records at a time
+ */
+static range_t *new_range(void)
+{
+    static unsigned int seed = 2463534242u;
+    range_t *p;
+    int i;
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
+    if (free_ranges == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in new_range");
+	for (i = 0; i < RANGE_CHUNK; i++)
+	    free_range(&p[i]);
+    }
+    p = free_ranges;
+    free_ranges = p->right;
+
+    /* xorshift priorities */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    p->prio = seed;
+    p->left = p->right = NULL;
+    return p;
+}
 
 /*
- * read_trace - read a trace file and store it in memory
+ * free_range - give a range record back to the pool
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static void free_range(range_t *p)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
+    p->right = free_ranges;
+    free_ranges = p;
+}
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
+/*
+ * split_ranges - split a tree into the ranges below lo and the others
+ */
+static void split_ranges(range_t *t, char *lo, range_t **left, range_t **right)
+{
+    while (t != NULL) {
+	if (t->lo < lo) {
+	    *left = t;
+	    left = &t->right;
+	    t = t->right;
+	}
+	else {
+	    *right = t;
+	    right = &t->left;
+	    t = t->left;
 	}
-	op_index++;
-	
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
+    *left = *right = NULL;
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * merge_ranges - join two trees, all ranges of left being below right
  */
-void free_trace(trace_t *trace)
+static range_t *merge_ranges(range_t *left, range_t *right)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    range_t *root;
+    range_t **link = &root;
+
+    while (left != NULL && right != NULL) {
+	if (left->prio > right->prio) {
+	    *link = left;
+	    link = &left->right;
+	    left = left->right;
+	}
+	else {
+	    *link = right;
+	    link = &right->left;
+	    right = right->left;
+	}
+    }
+    *link = (left != NULL) ? left : right;
+    return root;
 }
 
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -583,8 +937,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     char *newp;
     char *oldp;
     char *p;
+    traceop_t *op;
+    block_t *b;
     
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
 
@@ -596,10 +952,12 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
-	index = trace->ops[i].index;
-	size = trace->ops[i].size;
+	op = trace_op(trace, i);
+	index = op->index;
+	size = op->size;
+	b = trace_block(trace, index);
 
-        switch (trace->ops[i].type) {
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
 
@@ -611,7 +969,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
@@ -625,23 +983,23 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    memset(p, index & 0xFF, size);
 
 	    /* Remember region */
-	    trace->blocks[index] = p;
-	    trace->block_sizes[index] = size;
+	    b->ptr = p;
+	    b->size = size;
 	    break;
 
         case REALLOC: /* mm_realloc */
 	    
 	    /* Call the student's realloc */
-	    oldp = trace->blocks[index];
+	    oldp = b->ptr;
 	    if ((newp = mm_realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
 	    
@@ -650,10 +1008,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     * block and then fill in the new block with the low order byte
 	     * of the new index
 	     */
-	    oldsize = trace->block_sizes[index];
+	    oldsize = b->size;
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -662,16 +1020,17 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    memset(newp, index & 0xFF, size);
 
 	    /* Remember region */
-	    trace->blocks[index] = newp;
-	    trace->block_sizes[index] = size;
+	    b->ptr = newp;
+	    b->size = size;
 	    break;
 
         case FREE: /* mm_free */
 	    
 	    /* Remove region from list and call student's free function */
-	    p = trace->blocks[index];
+	    p = b->ptr;
 	    remove_range(ranges, p);
 	    mm_free(p);
+	    trace_drop_block(trace, index);
 	    break;
 
 	default:
@@ -693,9 +1052,17 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   package on the trace. Note that our implementation of mem_sbrk() 
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap. 
- *   
+ *
+ *   The pages of the heap are released before the run, and the payload
+ *   of every block is touched once per page, so that the resident size
+ *   of the heap after the run (see resident_util) is the one that an 
+ *   application writing its blocks would see.
+ *
+ *   The op after which the live payload is the largest is returned in
+ *   peak_op.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   int *peak_op)
 {   
     int i;
     int index;
@@ -704,63 +1071,74 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     int total_size = 0;
     char *p;
     char *newp, *oldp;
+    traceop_t *op;
+    block_t *b;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
+    mem_release_pages();
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+	op = trace_op(trace, i);
+	index = op->index;
+	b = trace_block(trace, index);
+
+        switch (op->type) {
 
         case ALLOC: /* mm_alloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+	    size = op->size;
 
 	    if ((p = mm_malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
+	    touch_payload(p, size);
 	    
 	    /* Remember region and size */
-	    trace->blocks[index] = p;
-	    trace->block_sizes[index] = size;
+	    b->ptr = p;
+	    b->size = size;
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
 	    total_size += size;
 	    
 	    /* Update statistics */
-	    max_total_size = (total_size > max_total_size) ?
-		total_size : max_total_size;
+	    if (total_size > max_total_size) {
+		max_total_size = total_size;
+		*peak_op = i;
+	    }
 	    break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldsize = trace->block_sizes[index];
+	    newsize = op->size;
+	    oldsize = b->size;
 
-	    oldp = trace->blocks[index];
+	    oldp = b->ptr;
 	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
+	    touch_payload(newp, newsize);
 
 	    /* Remember region and size */
-	    trace->blocks[index] = newp;
-	    trace->block_sizes[index] = newsize;
+	    b->ptr = newp;
+	    b->size = newsize;
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
 	    total_size += (newsize - oldsize);
 	    
 	    /* Update statistics */
-	    max_total_size = (total_size > max_total_size) ?
-		total_size : max_total_size;
+	    if (total_size > max_total_size) {
+		max_total_size = total_size;
+		*peak_op = i;
+	    }
 	    break;
 
         case FREE: /* mm_free */
-	    index = trace->ops[i].index;
-	    size = trace->block_sizes[index];
-	    p = trace->blocks[index];
+	    size = b->size;
+	    p = b->ptr;
 	    
 	    mm_free(p);
+	    trace_drop_block(trace, index);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -772,11 +1150,141 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	if (util_csv != NULL &&
+	    ((i + 1) % util_interval == 0 || i == trace->num_ops - 1))
+	    sample_heap(tracenum, i, total_size);
     }
 
     return ((double)max_total_size / (double)mem_heapsize());
 }
 
+/* State of the heap walk of eval_mm_frag */
+typedef struct {
+    block_t **live;  /* live blocks, sorted by payload address */
+    int num_live;
+    frag_t *frag;
+} frag_walk_t;
+
+static int cmp_block_ptr(const void *a, const void *b)
+{
+    char *pa = (*(block_t **)a)->ptr;
+    char *pb = (*(block_t **)b)->ptr;
+
+    return (pa > pb) - (pa < pb);
+}
+
+/*
+ * frag_visit - mm_heap_walk callback of eval_mm_frag: adds a part of
+ *    the heap to the breakdown
+ */
+static void frag_visit(void *arg, int kind, void *start, size_t len,
+		       void *payload, size_t usable)
+{
+    frag_walk_t *w = (frag_walk_t *)arg;
+    frag_t *frag = w->frag;
+    block_t key, *keyp = &key, **found;
+    size_t size, aligned;
+    int c;
+
+    switch (kind) {
+    case MM_WALK_USED:
+	key.ptr = payload;
+	found = bsearch(&keyp, w->live, w->num_live, sizeof(block_t *),
+			cmp_block_ptr);
+	size = (found != NULL) ? (size_t)(*found)->size : 0;
+	aligned = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	if (aligned > usable)
+	    aligned = usable;
+	frag->payload += size;
+	frag->align += aligned - size;
+	frag->header += len - usable;
+	frag->padding += usable - aligned;
+	break;
+
+    case MM_WALK_FREE:
+	if ((char *)start + len > (char *)mem_heap_hi()) {
+	    frag->tail += len;
+	    break;
+	}
+	for (c = 0; c < FRAG_CLASSES - 1 &&
+		 len >> (FRAG_MIN_CLASS + c + 1) != 0; c++)
+	    ;
+	frag->holes[c] += len;
+	break;
+
+    default:
+	frag->meta += len;
+    }
+}
+
+/*
+ * eval_mm_frag - Replay the trace up to its peak (see eval_mm_util) and
+ *    break the heap down with the heap walk of the mm package. The live
+ *    blocks are those of the block array, so traces whose ids are hashed
+ *    are not broken down.
+ */
+static void eval_mm_frag(trace_t *trace, int peak_op, frag_t *frag)
+{
+    int i, n;
+    char *p;
+    traceop_t *op;
+    block_t *b;
+    frag_walk_t w;
+
+    memset(frag, 0, sizeof(*frag));
+    if (trace->blocks == NULL)
+	return;
+    memset(trace->blocks, 0, trace->num_ids * sizeof(block_t));
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_frag");
+
+    for (i = 0; i <= peak_op && i < trace->num_ops; i++) {
+	op = trace_op(trace, i);
+	b = trace_block(trace, op->index);
+
+	switch (op->type) {
+	case ALLOC:
+	    if ((p = mm_malloc(op->size)) == NULL)
+		app_error("mm_malloc failed in eval_mm_frag");
+	    b->ptr = p;
+	    b->size = op->size;
+	    break;
+
+	case REALLOC:
+	    if ((p = mm_realloc(b->ptr, op->size)) == NULL)
+		app_error("mm_realloc failed in eval_mm_frag");
+	    b->ptr = p;
+	    b->size = op->size;
+	    break;
+
+	case FREE:
+	    mm_free(b->ptr);
+	    b->ptr = NULL;
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_frag");
+	}
+    }
+
+    w.live = (block_t **)malloc((trace->num_ids + 1) * sizeof(block_t *));
+    if (w.live == NULL)
+	unix_error("malloc failed in eval_mm_frag");
+    for (i = n = 0; i < trace->num_ids; i++)
+	if (trace->blocks[i].ptr != NULL)
+	    w.live[n++] = &trace->blocks[i];
+    qsort(w.live, n, sizeof(block_t *), cmp_block_ptr);
+    w.num_live = n;
+    w.frag = frag;
+
+    frag->heap = mem_heapsize();
+    mm_heap_walk(frag_visit, &w);
+    free(w.live);
+}
+
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -784,8 +1292,10 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, size, newsize;
     char *p, *newp, *oldp, *block;
+    traceop_t *op;
+    block_t *b;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
@@ -794,117 +1304,926 @@ static void eval_mm_speed(void *ptr)
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = trace_op(trace, i);
+	b = trace_block(trace, op->index);
+
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
+            size = op->size;
             if ((p = mm_malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
-            trace->blocks[index] = p;
+            b->ptr = p;
             break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
+            newsize = op->size;
+	    oldp = b->ptr;
             if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
-            trace->blocks[index] = newp;
+            b->ptr = newp;
             break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
+            block = b->ptr;
             mm_free(block);
+	    trace_drop_block(trace, op->index);
             break;
 
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
+    }
 }
 
-/*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
- */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static int cmp_double(const void *a, const void *b)
 {
-    int i, newsize;
-    char *p, *newp, *oldp;
+    double x = *(const double *)a, y = *(const double *)b;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    return (x > y) - (x < y);
+}
 
-        case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
-		malloc_error(tracenum, i, "libc malloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = p;
-	    break;
+static int cmp_float(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
 
-	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
-	    if ((newp = realloc(oldp, newsize)) == NULL) {
-		malloc_error(tracenum, i, "libc realloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = newp;
-	    break;
-	    
-        case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
-	    break;
+    return (x > y) - (x < y);
+}
 
-	default:
-	    app_error("invalid operation type  in eval_libc_valid");
+static double elapsed_ns(struct timespec *t0, struct timespec *t1)
+{
+    return 1e9 * (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec);
+}
+
+/*
+ * eval_mm_latency - Time every request of a trace on its own with
+ *    clock_gettime, less the cost of reading the clock (-L). The trace
+ *    is replayed LAT_REPLAYS times and every request keeps its fastest
+ *    time, so that an interrupt in one replay is not taken for the cost
+ *    of the request. The worst cases of the allocator show up as the
+ *    tail of the distribution: percentiles and slowest request.
+ */
+static void eval_mm_latency(trace_t *trace, lat_t *lat)
+{
+    int i, k, n = trace->num_ops;
+    char *p;
+    float *ns;
+    double t, ovhd = DBL_MAX;
+    struct timespec t0, t1;
+    traceop_t *op;
+    block_t *b;
+
+    lat->worst_op = -1;
+    if (n == 0)
+	return;
+    if ((ns = (float *)malloc(n * sizeof(float))) == NULL)
+	unix_error("malloc failed in eval_mm_latency");
+
+    for (k = 0; k < 1000; k++) {
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if ((t = elapsed_ns(&t0, &t1)) < ovhd)
+	    ovhd = t;
+    }
+
+    for (k = 0; k < LAT_REPLAYS; k++) {
+	mem_reset_brk();
+	if (mm_init() < 0) 
+	    app_error("mm_init failed in eval_mm_latency");
+
+	for (i = 0; i < n; i++) {
+	    op = trace_op(trace, i);
+	    b = trace_block(trace, op->index);
+	    clock_gettime(CLOCK_MONOTONIC, &t0);
+	    switch (op->type) {
+	    case ALLOC:
+		p = mm_malloc(op->size);
+		break;
+	    case REALLOC:
+		p = mm_realloc(b->ptr, op->size);
+		break;
+	    case FREE:
+		mm_free(b->ptr);
+		p = NULL;
+		break;
+	    default:
+		app_error("Nonexistent request type in eval_mm_latency");
+	    }
+	    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	    if (op->type == FREE)
+		trace_drop_block(trace, op->index);
+	    else if (p == NULL)
+		app_error("mm_malloc/mm_realloc error in eval_mm_latency");
+	    else
+		b->ptr = p;
+	    t = elapsed_ns(&t0, &t1) - ovhd;
+	    if (t < 0)
+		t = 0;
+	    if (k == 0 || t < ns[i])
+		ns[i] = (float)t;
 	}
     }
 
-    return 1;
+    for (i = 0; i < n; i++)
+	if (lat->worst_op < 0 || ns[i] > lat->max) {
+	    lat->max = ns[i];
+	    lat->worst_op = i;
+	}
+    op = trace_op(trace, lat->worst_op);
+    lat->worst_type = op->type;
+    lat->worst_size = op->size;
+
+    qsort(ns, n, sizeof(float), cmp_float);
+    lat->p50 = ns[(int)(0.5 * (n - 1))];
+    lat->p99 = ns[(int)(0.99 * (n - 1))];
+    lat->p999 = ns[(int)(0.999 * (n - 1))];
+    free(ns);
 }
 
-/* 
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+/*
+ * summarize - median, median absolute deviation and 95% confidence
+ *    interval of the median of n run times. The interval is
+ *    distribution-free: it lies between the order statistics of ranks
+ *    n/2 -+ 1.96 sqrt(n)/2, or is the whole range of the runs when there
+ *    are fewer than CI_MIN_RUNS of them.
  */
-static void eval_libc_speed(void *ptr)
+static void summarize(double *secs, int n, double *median, double *mad,
+		      double *ci_lo, double *ci_hi)
 {
-    int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
+    double sorted[MAX_RUNS], dev[MAX_RUNS];
+    int k, lo, hi;
+
+    memcpy(sorted, secs, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+    *median = (n % 2 == 1) ? sorted[n / 2] :
+	(sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+
+    for (k = 0; k < n; k++)
+	dev[k] = fabs(sorted[k] - *median);
+    qsort(dev, n, sizeof(double), cmp_double);
+    *mad = (n % 2 == 1) ? dev[n / 2] : (dev[n / 2 - 1] + dev[n / 2]) / 2;
+
+    lo = (int)floor(n / 2.0 - 1.96 * sqrt(n) / 2);   /* 0-based ranks */
+    hi = (int)ceil(n / 2.0 + 1.96 * sqrt(n) / 2);
+    if (n < CI_MIN_RUNS || lo < 0)
+	lo = 0;
+    if (n < CI_MIN_RUNS || hi > n - 1)
+	hi = n - 1;
+    *ci_lo = sorted[lo];
+    *ci_hi = sorted[hi];
+}
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+/*
+ * summarize_runs - summarize the first n runs of a trace into its secs,
+ *    mad and CI
+ */
+static void summarize_runs(stats_t *stats, int n)
+{
+    stats->runs = n;
+    summarize(stats->run_secs, n, &stats->secs, &stats->mad,
+	      &stats->ci_lo, &stats->ci_hi);
+}
+
+/*
+ * time_runs - time num_runs replays of a trace (-R) or, with -e, as many
+ *    as the 95% CI of their median needs to be within ci_target of it,
+ *    until MAX_RUNS runs or run_budget seconds. The times go to secs,
+ *    and, if ref is not NULL, every run is followed by a libc replay
+ *    timed into ref. Returns the number of runs, summarized as in
+ *    summarize.
+ */
+static int time_runs(speed_t *params, double *secs, double *ref,
+		     double *median, double *mad, double *ci_lo, double *ci_hi)
+{
+    struct timespec start, now;
+    int k, min_runs;
+
+    min_runs = num_runs;
+    if (ci_target > 0 && min_runs < CI_MIN_RUNS)
+	min_runs = CI_MIN_RUNS;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < MAX_RUNS; k++) {
+	secs[k] = fsecs(eval_mm_speed, params);
+	if (ref != NULL)
+	    ref[k] = fsecs(eval_libc_speed, params);
+	if (k + 1 < min_runs)
+	    continue;
+	summarize(secs, k + 1, median, mad, ci_lo, ci_hi);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ci_target == 0 ||
+	    (*ci_hi - *ci_lo) / 2 <= ci_target * *median ||
+	    (now.tv_sec - start.tv_sec) + 1e-9 * (now.tv_nsec - start.tv_nsec)
+	    >= run_budget)
+	    break;
+    }
+    return (k < MAX_RUNS) ? k + 1 : MAX_RUNS;
+}
+
+/*
+ * time_mm_trace - Time the mm package on a trace, after num_warmup
+ *    untimed replays. The runs are taken by time_runs, and the secs of
+ *    the trace is their median. With -o or -C, every run is followed by
+ *    a replay with libc malloc, the reference with which compare_results
+ *    cancels the changes of the machine speed between two invocations.
+ *    With -W, a second series of runs, with its own budget, evicts the
+ *    caches before every replay, and cold_secs is its median. With -c,
+ *    one more run counts the hardware events, and with -L more replays
+ *    time every request on its own.
+ */
+static void time_mm_trace(trace_t *trace, stats_t *stats)
+{
+    static int warned = 0;
+    speed_t speed_params;
+    double cold[MAX_RUNS];
+    double mad;
+    int k;
+
+    speed_params.trace = trace;
+    speed_params.ranges = NULL;
+    for (k = 0; k < num_warmup; k++)
+	eval_mm_speed(&speed_params);
+
+    stats->runs = time_runs(&speed_params, stats->run_secs,
+			    (results_file != NULL || baseline_file != NULL) ?
+			    stats->ref_secs : NULL, &stats->secs, &stats->mad,
+			    &stats->ci_lo, &stats->ci_hi);
+
+    if (cold_flag) {
+	set_fsecs_cold(1);
+	stats->cold_runs = time_runs(&speed_params, cold, NULL,
+				     &stats->cold_secs, &mad,
+				     &stats->cold_ci_lo, &stats->cold_ci_hi);
+	set_fsecs_cold(0);
+    }
+
+    if (counters_flag && 
+	pc_measure(eval_mm_speed, &speed_params, stats->counters) == 0 &&
+	!warned) {
+	printf("Hardware counters are not available "
+	       "(see /proc/sys/kernel/perf_event_paranoid)\n");
+	warned = 1;
+    }
+
+    if (latency_flag)
+	eval_mm_latency(trace, &stats->lat);
+}
+
+/*
+ * eval_mm_trace - Evaluate the correctness, the space utilization and,
+ *    if timed is set, the throughput of the mm package on one trace
+ */
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats, 
+			  int timed)
+{
+    static range_t *ranges = NULL;
+    trace_t *trace;
+    int peak_op = 0;
+
+    trace = load_trace(tracedir, tracefile);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	stats->util = eval_mm_util(trace, tracenum, &ranges, &peak_op);
+	stats->rss_util = resident_util(stats->util);
+	if (verbose > 1)
+	    printheapstats();
+	if (frag_flag)
+	    eval_mm_frag(trace, peak_op, &stats->frag);
+	if (timed) {
+	    if (verbose > 1)
+		printf("and performance.\n");
+	    time_mm_trace(trace, stats);
+	}
+	else if (verbose > 1)
+	    printf("\n");
+    }
+    free_trace(trace);
+}
+
+/*
+ * write_all - write len bytes to fd, resuming after short writes.
+ *    Returns -1 on error.
+ */
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    ssize_t n;
+
+    while (len > 0) {
+	if ((n = write(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/*
+ * read_all - read len bytes from fd, resuming after short reads.
+ *    Returns the number of bytes read, less than len only at the end
+ *    of the file or on error.
+ */
+static size_t read_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len) {
+	if ((n = read(fd, p + got, len - got)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	if (n == 0)
+	    break;
+	got += n;
+    }
+    return got;
+}
+
+/*
+ * eval_mm_parallel - Evaluate the traces in num_jobs worker processes,
+ *    each pinned to its own CPU and given every num_jobs'th trace. Every
+ *    worker sends its results through a pipe of its own, so results
+ *    larger than PIPE_BUF cannot interleave. Unless timed is set, the
+ *    throughput is then measured here, one trace at a time, so that the
+ *    timings do not compete with each other.
+ */
+static void eval_mm_parallel(char **tracefiles, int num_tracefiles, 
+			     stats_t *stats, int num_jobs, int timed)
+{
+    int (*fds)[2];
+    struct pollfd *pfds;
+    int i, w, status, num_open;
+    pid_t pid;
+    int num_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int *done;
+    cpu_set_t cpus;
+    result_t res;
+    trace_t *trace;
+
+    if ((done = (int *)calloc(num_tracefiles, sizeof(int))) == NULL ||
+	(fds = (int (*)[2])malloc(num_jobs * sizeof(*fds))) == NULL ||
+	(pfds = (struct pollfd *)malloc(num_jobs * sizeof(*pfds))) == NULL)
+	unix_error("malloc failed in eval_mm_parallel");
+    fflush(stdout);
+
+    for (w = 0; w < num_jobs; w++) {
+	if (pipe(fds[w]) < 0)
+	    unix_error("pipe failed in eval_mm_parallel");
+	if ((pid = fork()) < 0)
+	    unix_error("fork failed in eval_mm_parallel");
+	if (pid > 0) {
+	    close(fds[w][1]);
+	    continue;
+	}
+
+	/* Worker w */
+	for (i = 0; i <= w; i++)
+	    close(fds[i][0]);
+	if (num_cpus > 0) {
+	    CPU_ZERO(&cpus);
+	    CPU_SET(w % num_cpus, &cpus);
+	    sched_setaffinity(0, sizeof(cpus), &cpus);
+	}
+	for (i = w; i < num_tracefiles; i += num_jobs) {
+	    memset(&res, 0, sizeof(res));
+	    res.tracenum = i;
+	    eval_mm_trace(tracefiles[i], i, &res.stats, timed);
+	    res.errors = errors;
+	    errors = 0;
+	    fflush(stdout);
+	    if (write_all(fds[w][1], &res, sizeof(res)) < 0)
+		unix_error("write failed in eval_mm_parallel");
+	}
+	_exit(0);  /* the parent owns the atexit handlers */
+    }
+
+    /* Read the results until every worker has closed its pipe */
+    for (w = 0; w < num_jobs; w++) {
+	pfds[w].fd = fds[w][0];
+	pfds[w].events = POLLIN;
+    }
+    num_open = num_jobs;
+    while (num_open > 0) {
+	if (poll(pfds, num_jobs, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("poll failed in eval_mm_parallel");
+	}
+	for (w = 0; w < num_jobs; w++) {
+	    if (pfds[w].fd < 0 || pfds[w].revents == 0)
+		continue;
+	    if (read_all(pfds[w].fd, &res, sizeof(res)) == sizeof(res)) {
+		stats[res.tracenum] = res.stats;
+		errors += res.errors;
+		done[res.tracenum] = 1;
+		continue;
+	    }
+	    close(pfds[w].fd);  /* a partial result means the worker died */
+	    pfds[w].fd = -1;
+	    num_open--;
+	}
+    }
+    while (wait(&status) > 0)
+	;
+
+    for (i = 0; i < num_tracefiles; i++) {
+	if (!done[i]) {
+	    printf("Trace %d: the worker process died\n", i);
+	    errors++;
+	}
+	else if (!timed && stats[i].valid) {
+	    trace = load_trace(tracedir, tracefiles[i]);
+	    if (verbose > 1)
+		printf("Measuring the performance of trace %d.\n", i);
+	    time_mm_trace(trace, &stats[i]);
+	    free_trace(trace);
+	}
+    }
+    free(pfds);
+    free(fds);
+    free(done);
+}
+
+/*
+ * annotate_phases - Cut the trace into phases of phase_len ops and find,
+ *    for every alloc and realloc op, the phase in which its block dies
+ *    (the phase of the next free of the same id, or the last phase).
+ *    Ids that are ever reallocated don't fit an arena, since every copy
+ *    would stay until the end of the phase: all their ops get phase -1,
+ *    and are replayed with mm_malloc/mm_realloc/mm_free. The requests are
+ *    accessed out of order, so the trace must be loaded (not streamed).
+ */
+static void annotate_phases(trace_t *trace, int phase_len)
+{
+    int i, index;
+    int *next_free;
+
+    trace->phase_len = phase_len;
+    trace->num_phases = (trace->num_ops + phase_len - 1) / phase_len;
+    if ((trace->death_phases = 
+	 (int *)malloc(trace->num_ops * sizeof(int))) == NULL)
+	unix_error("malloc 1 failed in annotate_phases");
+    if ((next_free = (int *)malloc(trace->num_ids * sizeof(int))) == NULL)
+	unix_error("malloc 2 failed in annotate_phases");
+
+    /* next_free[index] is -1 for ids that are reallocated */
+    for (index = 0;  index < trace->num_ids;  index++)
+	next_free[index] = trace->num_ops - 1;
+    for (i = 0;  i < trace->num_ops;  i++)
+	if (trace->ops[i].type == REALLOC)
+	    next_free[trace->ops[i].index] = -1;
+
+    /* Walk backwards, remembering the next free of each id */
+    for (i = trace->num_ops - 1;  i >= 0;  i--) {
+	index = trace->ops[i].index;
+	if (next_free[index] < 0)
+	    trace->death_phases[i] = -1;
+	else if (trace->ops[i].type == FREE) {
+	    next_free[index] = i;
+	    trace->death_phases[i] = i / phase_len;
+	}
+	else
+	    trace->death_phases[i] = next_free[index] / phase_len;
+    }
+    free(next_free);
+}
+
+/*
+ * arena_replay - Replay a trace with phase arenas. Arenas are created on
+ *    demand and recycled through a spare stack once their phase ends, so
+ *    their chunks are reused by later phases. If touch is set, the payloads
+ *    are touched as in eval_mm_util. Returns the high water mark of the
+ *    live payload bytes, or -1 if the heap ran out of memory.
+ */
+static int arena_replay(trace_t *trace, int touch)
+{
+    int i, index, size, phase;
+    int total_size = 0;
+    int max_total_size = 0;
+    int num_spares = 0;
+    char *p;
+    traceop_t *op;
+    block_t *b;
+    mm_arena_t **arenas, **spares;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in arena_replay");
+
+    arenas = (mm_arena_t **)calloc(trace->num_phases, sizeof(mm_arena_t *));
+    spares = (mm_arena_t **)malloc(trace->num_phases * sizeof(mm_arena_t *));
+    if (arenas == NULL || spares == NULL)
+	unix_error("malloc failed in arena_replay");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = trace_op(trace, i);
+	index = op->index;
+	size = op->size;
+	phase = trace->death_phases[i];
+	b = trace_block(trace, index);
+
+        switch (op->type) {
+
+        case ALLOC: /* mm_arena_alloc, or mm_malloc for reallocated ids */
+	    p = NULL;
+	    if (phase < 0) {
+		p = mm_malloc(size);
+	    }
+	    else {
+		if (arenas[phase] == NULL) {
+		    if (num_spares > 0)
+			arenas[phase] = spares[--num_spares];
+		    else 
+			arenas[phase] = mm_arena_create(0);
+		}
+		if (arenas[phase] != NULL)
+		    p = mm_arena_alloc(arenas[phase], size);
+	    }
+	    if (p == NULL)
+		max_total_size = -1;
+	    else if (touch)
+		touch_payload(p, size);
+	    b->ptr = p;
+	    b->size = size;
+	    total_size += size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    if ((p = mm_realloc(b->ptr, size)) == NULL)
+		max_total_size = -1;
+	    else if (touch)
+		touch_payload(p, size);
+	    b->ptr = p;
+	    total_size += size - b->size;
+	    b->size = size;
+	    break;
+
+        case FREE: /* mm_free, arena blocks wait for the end of the phase */
+	    if (phase < 0)
+		mm_free(b->ptr);
+	    total_size -= b->size;
+	    trace_drop_block(trace, index);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in arena_replay");
+        }
+
+	if (max_total_size < 0)
+	    break;
+	max_total_size = (total_size > max_total_size) ?
+	    total_size : max_total_size;
+
+	/* Recycle the arena of the phase that ends with this op */
+	if ((i + 1) % trace->phase_len == 0 || i == trace->num_ops - 1) {
+	    phase = i / trace->phase_len;
+	    if (arenas[phase] != NULL) {
+		mm_arena_reset(arenas[phase]);
+		spares[num_spares++] = arenas[phase];
+		arenas[phase] = NULL;
+	    }
+	}
+    }
+
+    while (num_spares > 0)
+	mm_arena_destroy(spares[--num_spares]);
+    free(arenas);
+    free(spares);
+    return max_total_size;
+}
+
+/*
+ * eval_arena_util - Evaluate the space utilization of the phase arena
+ *    replay, with the same definition as in eval_mm_util.
+ */
+static double eval_arena_util(trace_t *trace)
+{
+    int max_total_size;
+
+    mem_reset_brk();
+    mem_release_pages();
+    max_total_size = arena_replay(trace, 1);
+
+    if (max_total_size < 0)
+	return -1;
+    return ((double)max_total_size / (double)mem_heapsize());
+}
+
+/*
+ * eval_arena_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the phase arena replay.
+ */
+static void eval_arena_speed(void *ptr)
+{
+    if (arena_replay(((speed_t *)ptr)->trace, 0) < 0)
+	app_error("arena replay ran out of memory in eval_arena_speed");
+}
+
+/*
+ * pool_replay - Replay a trace with object pools. A request of at most
+ *    pool_max bytes gets an object of the pool of its size rounded up to
+ *    ALIGNMENT, created on demand; larger requests and all the ops of the
+ *    ids that are ever reallocated go to mm_malloc/mm_realloc/mm_free.
+ *    If ranges is set, the payloads are checked as in eval_mm_valid, and
+ *    each one must still hold its fill byte when it is freed. If touch is
+ *    set, the payloads are touched as in eval_mm_util. If pstats is set,
+ *    it receives the sum of the pool statistics at the peak of the live
+ *    bytes. Returns the high water mark of the live payload bytes, or -1
+ *    on an error.
+ */
+static int pool_replay(trace_t *trace, int pool_max, int tracenum,
+		       range_t **ranges, int touch, mm_stats_t *pstats)
+{
+    int i, j, index, size, oldsize, class;
+    int total_size = 0;
+    int max_total_size = 0;
+    int num_classes = pool_max / ALIGNMENT + 1;
+    char *p, *newp;
+    char *resized;
+    traceop_t *op;
+    block_t *b;
+    mm_pool_t **pools;
+    mm_stats_t st;
+
+    mem_reset_brk();
+    if (ranges != NULL)
+	clear_ranges(ranges);
+    if (mm_init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	return -1;
+    }
+
+    pools = (mm_pool_t **)calloc(num_classes, sizeof(mm_pool_t *));
+    resized = (char *)calloc(trace->num_ids, 1);
+    if (pools == NULL || resized == NULL)
+	unix_error("calloc failed in pool_replay");
+    for (i = 0;  i < trace->num_ops;  i++)
+	if (trace->ops[i].type == REALLOC)
+	    resized[trace->ops[i].index] = 1;
+
+/* Is the block of index (of size bytes) an object of a pool? */
+#define POOLED(index, size) \
+    ((size) > 0 && (size_t)(size) <= (size_t)pool_max && !resized[index])
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = trace_op(trace, i);
+	index = op->index;
+	size = op->size;
+	b = trace_block(trace, index);
+
+        switch (op->type) {
+
+        case ALLOC: /* mm_pool_alloc, or mm_malloc */
+	    if (POOLED(index, size)) {
+		class = (size + ALIGNMENT-1) / ALIGNMENT;
+		if (pools[class] == NULL)
+		    pools[class] = mm_pool_create(class * ALIGNMENT, 0);
+		p = (pools[class] != NULL) ? mm_pool_alloc(pools[class]) : NULL;
+	    }
+	    else
+		p = mm_malloc(size);
+	    if (p == NULL) {
+		if (ranges != NULL)
+		    malloc_error(tracenum, i, "pool replay ran out of memory.");
+		max_total_size = -1;
+		break;
+	    }
+	    if (ranges != NULL) {
+		if (add_range(ranges, p, size, tracenum, i) == 0) {
+		    max_total_size = -1;
+		    break;
+		}
+		memset(p, index & 0xFF, size);
+	    }
+	    else if (touch)
+		touch_payload(p, size);
+	    b->ptr = p;
+	    b->size = size;
+	    total_size += size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    if ((newp = mm_realloc(b->ptr, size)) == NULL) {
+		if (ranges != NULL)
+		    malloc_error(tracenum, i, "mm_realloc failed.");
+		max_total_size = -1;
+		break;
+	    }
+	    if (ranges != NULL) {
+		remove_range(ranges, b->ptr);
+		if (add_range(ranges, newp, size, tracenum, i) == 0) {
+		    max_total_size = -1;
+		    break;
+		}
+		oldsize = b->size;
+		if (size < oldsize)
+		    oldsize = size;
+		for (j = 0;  j < oldsize;  j++)
+		    if ((unsigned char)newp[j] != (index & 0xFF))
+			break;
+		if (j < oldsize) {
+		    malloc_error(tracenum, i, "mm_realloc did not preserve "
+				 "the data from old block");
+		    max_total_size = -1;
+		    break;
+		}
+		memset(newp, index & 0xFF, size);
+	    }
+	    else if (touch)
+		touch_payload(newp, size);
+	    b->ptr = newp;
+	    total_size += size - b->size;
+	    b->size = size;
+	    break;
+
+        case FREE: /* mm_pool_free, or mm_free */
+	    p = b->ptr;
+	    if (ranges != NULL) {
+		oldsize = b->size;
+		for (j = 0;  j < oldsize;  j++)
+		    if ((unsigned char)p[j] != (index & 0xFF))
+			break;
+		if (j < oldsize) {
+		    malloc_error(tracenum, i, "payload overwritten before "
+				 "its free");
+		    max_total_size = -1;
+		    break;
+		}
+		remove_range(ranges, p);
+	    }
+	    if (POOLED(index, b->size))
+		mm_pool_free(pools[(b->size + ALIGNMENT-1) / ALIGNMENT], p);
+	    else
+		mm_free(p);
+	    total_size -= b->size;
+	    trace_drop_block(trace, index);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in pool_replay");
+        }
+
+	if (max_total_size < 0)
+	    break;
+	if (total_size > max_total_size) {
+	    max_total_size = total_size;
+	    if (pstats != NULL) {
+		memset(pstats, 0, sizeof(*pstats));
+		for (class = 0;  class < num_classes;  class++) {
+		    if (pools[class] == NULL)
+			continue;
+		    mm_pool_stats(pools[class], &st);
+		    pstats->heap_bytes += st.heap_bytes;
+		    pstats->used_bytes += st.used_bytes;
+		    pstats->free_bytes += st.free_bytes;
+		    pstats->nb_used += st.nb_used;
+		    pstats->nb_free += st.nb_free;
+		    if (st.largest_free > pstats->largest_free)
+			pstats->largest_free = st.largest_free;
+		}
+	    }
+	}
+    }
+#undef POOLED
+
+    for (class = 0;  class < num_classes;  class++)
+	if (pools[class] != NULL)
+	    mm_pool_destroy(pools[class]);
+    free(pools);
+    free(resized);
+    return max_total_size;
+}
+
+/*
+ * eval_pool_util - Evaluate the space utilization of the object pool
+ *    replay, with the same definition as in eval_mm_util
+ */
+static double eval_pool_util(trace_t *trace, int pool_max, mm_stats_t *pstats)
+{
+    int max_total_size;
+
+    mem_reset_brk();
+    mem_release_pages();
+    max_total_size = pool_replay(trace, pool_max, 0, NULL, 1, pstats);
+
+    if (max_total_size < 0)
+	return -1;
+    return ((double)max_total_size / (double)mem_heapsize());
+}
+
+/*
+ * eval_pool_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the object pool replay.
+ */
+static void eval_pool_speed(void *ptr)
+{
+    speed_t *params = (speed_t *)ptr;
+
+    if (pool_replay(params->trace, params->pool_max, 0, NULL, 0, NULL) < 0)
+	app_error("pool replay ran out of memory in eval_pool_speed");
+}
+
+/*
+ * eval_libc_valid - We run this function to make sure that the
+ *    libc malloc can run to completion on the set of traces.
+ *    We'll be conservative and terminate if any libc malloc call fails.
+ *
+ */
+static int eval_libc_valid(trace_t *trace, int tracenum)
+{
+    int i, newsize;
+    char *p, *newp, *oldp;
+    traceop_t *op;
+    block_t *b;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = trace_op(trace, i);
+	b = trace_block(trace, op->index);
+
+        switch (op->type) {
+
+        case ALLOC: /* malloc */
+	    if ((p = malloc(op->size)) == NULL) {
+		malloc_error(tracenum, i, "libc malloc failed");
+		unix_error("System message");
+	    }
+	    b->ptr = p;
+	    break;
+
+	case REALLOC: /* realloc */
+            newsize = op->size;
+	    oldp = b->ptr;
+	    if ((newp = realloc(oldp, newsize)) == NULL) {
+		malloc_error(tracenum, i, "libc realloc failed");
+		unix_error("System message");
+	    }
+	    b->ptr = newp;
+	    break;
+	    
+        case FREE: /* free */
+	    free(b->ptr);
+	    trace_drop_block(trace, op->index);
+	    break;
+
+	default:
+	    app_error("invalid operation type  in eval_libc_valid");
+	}
+    }
+
+    return 1;
+}
+
+/* 
+ * eval_libc_speed - This is the function that is used by fcyc() to
+ *    measure the running time of the libc malloc package on the set
+ *    of traces.
+ */
+static void eval_libc_speed(void *ptr)
+{
+    int i;
+    int size, newsize;
+    char *p, *newp, *oldp, *block;
+    traceop_t *op;
+    block_t *b;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = trace_op(trace, i);
+	b = trace_block(trace, op->index);
+
+        switch (op->type) {
         case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+	    size = op->size;
 	    if ((p = malloc(size)) == NULL)
 		unix_error("malloc failed in eval_libc_speed");
-	    trace->blocks[index] = p;
+	    b->ptr = p;
 	    break;
 
 	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
+	    newsize = op->size;
+	    oldp = b->ptr;
 	    if ((newp = realloc(oldp, newsize)) == NULL)
 		unix_error("realloc failed in eval_libc_speed\n");
 	    
-	    trace->blocks[index] = newp;
+	    b->ptr = newp;
 	    break;
 	    
         case FREE: /* free */
-	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
+	    block = b->ptr;
 	    free(block);
+	    trace_drop_block(trace, op->index);
 	    break;
 	}
     }
@@ -924,54 +2243,822 @@ static void printresults(int n, stats_t *stats)
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double rss_util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%6s%8s%10s%6s\n", 
+	   "trace", " valid", "util", "rutil", "ops", "secs", "Kops");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f\n", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
+		   stats[i].rss_util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
+	    rss_util += stats[i].rss_util;
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%6s%8s%10s%6s\n", 
 		   i,
 		   "no",
 		   "-",
 		   "-",
 		   "-",
+		   "-",
 		   "-");
 	}
     }
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f\n", 
 	       "Total       ",
 	       (util/n)*100.0,
+	       (rss_util/n)*100.0,
 	       ops, 
 	       secs,
 	       (ops/1e3)/secs);
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%6s%8s%10s%6s\n", 
 	       "Total       ",
 	       "-", 
 	       "-", 
 	       "-", 
+	       "-", 
 	       "-");
     }
 
 }
 
+/*
+ * touch_payload - write one byte in every page of a payload, so that
+ *    the pages of the block become resident
+ */
+static void touch_payload(char *p, int size)
+{
+    int pagesize = (int)mem_pagesize();
+    int i;
+
+    for (i = 0; i < size; i += pagesize - (int)((size_t)(p + i) % pagesize))
+	p[i] = 0;
+}
+
+/*
+ * sample_heap - write a row of heap statistics to the CSV file of -u:
+ *    the live payload bytes after op, the heap size, their ratio, the
+ *    free bytes and blocks, the largest free block and the length of
+ *    every free list of the engine
+ */
+static void sample_heap(int tracenum, int op, int live_bytes)
+{
+    static int header = 0;
+    mm_stats_t st;
+    size_t k;
+
+    mm_stats(&st);
+    if (!header) {
+	fprintf(util_csv, "trace,op,live_bytes,heap_bytes,util,free_bytes,"
+		"nb_free,largest_free");
+	for (k = 0; k < st.nb_lists; k++)
+	    fprintf(util_csv, ",list%lu", (unsigned long)k);
+	fprintf(util_csv, "\n");
+	header = 1;
+    }
+    fprintf(util_csv, "%d,%d,%d,%lu,%.4f,%lu,%lu,%lu", tracenum, op,
+	    live_bytes, (unsigned long)st.heap_bytes,
+	    st.heap_bytes ? (double)live_bytes / st.heap_bytes : 0.0,
+	    (unsigned long)st.free_bytes, (unsigned long)st.nb_free,
+	    (unsigned long)st.largest_free);
+    for (k = 0; k < st.nb_lists; k++)
+	fprintf(util_csv, ",%lu", (unsigned long)st.list_len[k]);
+    fprintf(util_csv, "\n");
+}
+
+/*
+ * resident_util - convert the utilization of the current heap into the
+ *    one relative to its resident pages (max live bytes / resident bytes)
+ */
+static double resident_util(double util)
+{
+    size_t resident = mem_resident();
+
+    if (resident == 0)
+	return 0;
+    return util * (double)mem_heapsize() / (double)resident;
+}
+
+/*
+ * printheapstats - prints the heap statistics of the mm package
+ */
+static void printheapstats(void)
+{
+    mm_stats_t st;
+
+    mm_stats(&st);
+    printf("heap %lu bytes (%lu resident): %lu used in %lu blocks, "
+	   "%lu free in %lu blocks (largest %lu), ",
+	   (unsigned long)st.heap_bytes, (unsigned long)mem_resident(),
+	   (unsigned long)st.used_bytes, (unsigned long)st.nb_used,
+	   (unsigned long)st.free_bytes, (unsigned long)st.nb_free,
+	   (unsigned long)st.largest_free);
+}
+
+/*
+ * printpoolstats - prints the statistics of the pools of a trace (-O -V),
+ *    summed over its pools, at the peak of its live bytes
+ */
+static void printpoolstats(int tracenum, mm_stats_t *st)
+{
+    printf("Trace %d: pools at the peak, %lu bytes of chunks: "
+	   "%lu used in %lu objects, %lu free in %lu objects\n", tracenum,
+	   (unsigned long)st->heap_bytes,
+	   (unsigned long)st->used_bytes, (unsigned long)st->nb_used,
+	   (unsigned long)st->free_bytes, (unsigned long)st->nb_free);
+}
+
+/*
+ * printfrag - print the heap of every trace at its peak (-F), in percent
+ *    of the heap, then the bytes of the holes of every size class
+ */
+static void printfrag(int n, stats_t *stats)
+{
+    int i, c;
+    size_t holes;
+    frag_t *f;
+
+    printf("Heap at the peak of the traces (%% of the heap):\n");
+    printf("%5s%11s%8s%6s%7s%6s%7s%6s%6s\n", "trace", "heap", "payload",
+	   "align", "header", "pad", "holes", "tail", "meta");
+    for (i = 0; i < n; i++) {
+	f = &stats[i].frag;
+	if (!stats[i].valid || f->heap == 0) {
+	    printf("%2d%14s\n", i, "-");
+	    continue;
+	}
+	for (holes = 0, c = 0; c < FRAG_CLASSES; c++)
+	    holes += f->holes[c];
+	printf("%2d%14lu%7.1f%%%5.1f%%%6.1f%%%5.1f%%%6.1f%%%5.1f%%%5.1f%%\n",
+	       i, (unsigned long)f->heap,
+	       100.0 * f->payload / f->heap, 100.0 * f->align / f->heap,
+	       100.0 * f->header / f->heap, 100.0 * f->padding / f->heap,
+	       100.0 * holes / f->heap, 100.0 * f->tail / f->heap,
+	       100.0 * f->meta / f->heap);
+    }
+
+    printf("Holes by size class (bytes in holes of 2^k bytes or more):\n");
+    for (i = 0; i < n; i++) {
+	f = &stats[i].frag;
+	if (!stats[i].valid || f->heap == 0)
+	    continue;
+	printf("%2d  ", i);
+	for (holes = 0, c = 0; c < FRAG_CLASSES; c++)
+	    if (f->holes[c] > 0) {
+		printf(" 2^%d:%lu", FRAG_MIN_CLASS + c,
+		       (unsigned long)f->holes[c]);
+		holes += f->holes[c];
+	    }
+	printf("%s\n", holes == 0 ? " -" : "");
+    }
+    printf("\n");
+}
+
+/*
+ * printcounters - print the hardware events of every trace (-c), per
+ *    op of the trace, and the instructions per cycle
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    static const char *heads[PC_NB_EVENTS] = {
+	"cycles", "instrs", "L1D", "LLC", "brmiss", "dTLB"
+    };
+    double *cnt;
+    int i, e;
+
+    printf("Hardware events per op:\n%5s", "trace");
+    for (e = 0; e < PC_NB_EVENTS; e++)
+	printf("%9s", heads[e]);
+    printf("%7s\n", "IPC");
+    for (i = 0; i < n; i++) {
+	cnt = stats[i].counters;
+	printf("%2d   ", i);
+	for (e = 0; e < PC_NB_EVENTS; e++) {
+	    if (stats[i].valid && stats[i].runs > 0 && cnt[e] >= 0)
+		printf("%9.2f", cnt[e] / stats[i].ops);
+	    else
+		printf("%9s", "-");
+	}
+	if (stats[i].valid && stats[i].runs > 0 && 
+	    cnt[PC_CYCLES] > 0 && cnt[PC_INSTRUCTIONS] >= 0)
+	    printf("%7.2f\n", cnt[PC_INSTRUCTIONS] / cnt[PC_CYCLES]);
+	else
+	    printf("%7s\n", "-");
+    }
+    printf("\n");
+}
+
+/*
+ * printruns - print the spread of the timed runs of every trace: their
+ *    number, median, MAD and 95% CI of the median, in secs of a replay
+ */
+static void printruns(int n, stats_t *stats)
+{
+    int i;
+
+    printf("Timed runs (secs of a replay):\n");
+    printf("%5s%6s%11s%7s%24s%7s\n", 
+	   "trace", "runs", "median", "MAD", "95% CI", "+-");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid || stats[i].runs == 0) {
+	    printf("%2d%9s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%9d%11.6f%6.1f%%  [%9.6f, %9.6f]%6.1f%%\n", i, 
+	       stats[i].runs, stats[i].secs, 100 * stats[i].mad / stats[i].secs,
+	       stats[i].ci_lo, stats[i].ci_hi, 
+	       100 * (stats[i].ci_hi - stats[i].ci_lo) / 2 / stats[i].secs);
+    }
+    printf("\n");
+}
+
+/*
+ * printcold - print the throughput of every trace with warm caches, as
+ *    in the results table, and with caches evicted before each replay
+ *    (-W), with the number of cold runs and the half-width of the 95% CI
+ *    of their median
+ */
+static void printcold(int n, stats_t *stats)
+{
+    int i;
+
+    printf("Throughput with warm and cold caches (Kops):\n");
+    printf("%5s%9s%9s%8s%6s%7s\n", "trace", "warm", "cold", "ratio", "runs",
+	   "+-");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid || stats[i].runs == 0 || stats[i].cold_secs <= 0) {
+	    printf("%2d%10s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%12.0f%9.0f%8.2f%6d%6.1f%%\n", i,
+	       stats[i].ops / stats[i].secs / 1e3,
+	       stats[i].ops / stats[i].cold_secs / 1e3, 
+	       stats[i].cold_secs / stats[i].secs, stats[i].cold_runs,
+	       100 * (stats[i].cold_ci_hi - stats[i].cold_ci_lo) / 2 /
+	       stats[i].cold_secs);
+    }
+    printf("\n");
+}
+
+/*
+ * printlatency - print the latency of the requests of every trace (-L),
+ *    and its slowest request: index in the trace, type and size
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    static const char types[] = "afr";
+    int i;
+    lat_t *l;
+
+    printf("Latency of the requests (ns, fastest of %d replays):\n", 
+	   LAT_REPLAYS);
+    printf("%5s%9s%9s%9s%10s  %s\n", 
+	   "trace", "p50", "p99", "p99.9", "max", "slowest");
+    for (i = 0; i < n; i++) {
+	l = &stats[i].lat;
+	if (!stats[i].valid || l->worst_op < 0) {
+	    printf("%2d%10s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%12.0f%9.0f%9.0f%10.0f  op %d (%c %d)\n", i, l->p50, 
+	       l->p99, l->p999, l->max, l->worst_op, types[l->worst_type],
+	       l->worst_size);
+    }
+    printf("\n");
+}
+
+/*
+ * json_string - print a string as a JSON string literal
+ */
+static void json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (; *str; str++) {
+	if (*str == '"' || *str == '\\')
+	    fprintf(fp, "\\%c", *str);
+	else if ((unsigned char)*str < 0x20)
+	    fprintf(fp, "\\u%04x", (unsigned char)*str);
+	else
+	    fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * write_results - write the mm results to a file: CSV if its name ends
+ *    with ".csv", JSON otherwise. Both start with the metadata of the
+ *    run. The CSV file has one row per timed run of every trace; the
+ *    JSON file one object per trace, on a line of its own, with the
+ *    secs of the runs and the heap breakdown of -F. compare_results
+ *    reads both formats.
+ */
+static void write_results(char *file, int argc, char **argv, 
+			  char **tracefiles, int n, stats_t *stats, 
+			  double perfindex)
+{
+    FILE *fp;
+    char date[64], host[256], cmd[MAXLINE];
+    time_t now = time(NULL);
+    size_t len = strlen(file);
+    int csv = len >= 4 && strcmp(file + len - 4, ".csv") == 0;
+    int i, k, c;
+    frag_t *f;
+
+    if ((fp = fopen(file, "w")) == NULL) {
+	sprintf(msg, "Could not open %s", file);
+	unix_error(msg);
+    }
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    if (gethostname(host, sizeof(host)) < 0)
+	strcpy(host, "unknown");
+    host[sizeof(host) - 1] = '\0';
+    cmd[0] = '\0';
+    for (i = 0; i < argc && strlen(cmd) + strlen(argv[i]) + 2 < MAXLINE; i++) {
+	if (i > 0)
+	    strcat(cmd, " ");
+	strcat(cmd, argv[i]);
+    }
+
+    if (csv) {
+	fprintf(fp, "# date: %s\n# host: %s\n# command: %s\n", date, host, cmd);
+	fprintf(fp, "# team: %s\n# tracedir: %s\n# timing: %s\n", 
+		team.teamname, tracedir, fsecs_method());
+	fprintf(fp, "# runs: %d\n# warmup: %d\n# ci_target: %g\n"
+		"# cpu: %d\n# alignment: %d\n# perf_index: %.1f\n",
+		num_runs, num_warmup, ci_target, pin_cpu, ALIGNMENT, 
+		perfindex);
+	fprintf(fp, "trace,file,valid,ops,util,rss_util,run,secs,ref_secs,"
+		"heap,payload,align,header,padding,holes,tail,meta,"
+		"mad,ci_lo,ci_hi,cold_secs,cold_runs,cold_ci_lo,cold_ci_hi");
+	for (c = 0; counters_flag && c < PC_NB_EVENTS; c++)
+	    fprintf(fp, ",%s", pc_names[c]);
+	if (latency_flag)
+	    fprintf(fp, ",lat_p50,lat_p99,lat_p999,lat_max,lat_worst_op");
+	fprintf(fp, "\n");
+	for (i = 0; i < n; i++) {
+	    f = &stats[i].frag;
+	    for (k = 0; k < stats[i].runs || (k == 0 && stats[i].runs == 0);
+		 k++) {
+		fprintf(fp, "%d,%s,%d,%.0f,%.6f,%.6f,%d,%.9g,%.9g", i, 
+			tracefiles[i], stats[i].valid, stats[i].ops, 
+			stats[i].util, stats[i].rss_util, k, 
+			stats[i].runs > 0 ? stats[i].run_secs[k] : 0.0,
+			stats[i].runs > 0 ? stats[i].ref_secs[k] : 0.0);
+		for (len = 0, c = 0; c < FRAG_CLASSES; c++)
+		    len += f->holes[c];
+		fprintf(fp, ",%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+			(unsigned long)f->heap, (unsigned long)f->payload,
+			(unsigned long)f->align, (unsigned long)f->header,
+			(unsigned long)f->padding, (unsigned long)len,
+			(unsigned long)f->tail, (unsigned long)f->meta);
+		fprintf(fp, ",%.9g,%.9g,%.9g,%.9g,%d,%.9g,%.9g", stats[i].mad,
+			stats[i].ci_lo, stats[i].ci_hi, stats[i].cold_secs,
+			stats[i].cold_runs, stats[i].cold_ci_lo,
+			stats[i].cold_ci_hi);
+		for (c = 0; counters_flag && c < PC_NB_EVENTS; c++)
+		    fprintf(fp, ",%.0f", stats[i].counters[c]);
+		if (latency_flag)
+		    fprintf(fp, ",%.0f,%.0f,%.0f,%.0f,%d", stats[i].lat.p50,
+			    stats[i].lat.p99, stats[i].lat.p999, 
+			    stats[i].lat.max, stats[i].lat.worst_op);
+		fprintf(fp, "\n");
+	    }
+	}
+    }
+    else {
+	fprintf(fp, "{\n  \"meta\": {\"date\": \"%s\", \"host\": ", date);
+	json_string(fp, host);
+	fprintf(fp, ", \"command\": ");
+	json_string(fp, cmd);
+	fprintf(fp, ", \"team\": ");
+	json_string(fp, team.teamname);
+	fprintf(fp, ", \"tracedir\": ");
+	json_string(fp, tracedir);
+	fprintf(fp, ", \"timing\": \"%s\", \"runs\": %d, \"warmup\": %d, "
+		"\"ci_target\": %g, \"cpu\": %d, \"alignment\": %d, "
+		"\"perf_index\": %.1f},\n  \"traces\": [\n", 
+		fsecs_method(), num_runs, num_warmup, ci_target, pin_cpu,
+		ALIGNMENT, perfindex);
+	for (i = 0; i < n; i++) {
+	    fprintf(fp, "    {\"trace\": %d, \"file\": ", i);
+	    json_string(fp, tracefiles[i]);
+	    fprintf(fp, ", \"valid\": %d, \"ops\": %.0f, \"util\": %.6f, "
+		    "\"rss_util\": %.6f, \"secs\": %.9g, \"mad\": %.9g, "
+		    "\"ci\": [%.9g, %.9g], \"cold_secs\": %.9g, "
+		    "\"cold_runs\": %d, \"cold_ci\": [%.9g, %.9g], \"runs\": [",
+		    stats[i].valid, stats[i].ops, stats[i].util, 
+		    stats[i].rss_util, stats[i].secs, stats[i].mad,
+		    stats[i].ci_lo, stats[i].ci_hi, stats[i].cold_secs,
+		    stats[i].cold_runs, stats[i].cold_ci_lo, stats[i].cold_ci_hi);
+	    for (k = 0; k < stats[i].runs; k++)
+		fprintf(fp, "%s%.9g", k > 0 ? ", " : "", stats[i].run_secs[k]);
+	    fprintf(fp, "], \"ref\": [");
+	    for (k = 0; k < stats[i].runs; k++)
+		fprintf(fp, "%s%.9g", k > 0 ? ", " : "", stats[i].ref_secs[k]);
+	    fprintf(fp, "]");
+	    f = &stats[i].frag;
+	    if (f->heap > 0) {
+		fprintf(fp, ", \"frag\": {\"heap\": %lu, \"payload\": %lu, "
+			"\"align\": %lu, \"header\": %lu, \"padding\": %lu, "
+			"\"holes\": [", 
+			(unsigned long)f->heap, (unsigned long)f->payload,
+			(unsigned long)f->align, (unsigned long)f->header,
+			(unsigned long)f->padding);
+		for (c = 0; c < FRAG_CLASSES; c++)
+		    fprintf(fp, "%s%lu", c > 0 ? ", " : "", 
+			    (unsigned long)f->holes[c]);
+		fprintf(fp, "], \"tail\": %lu, \"meta\": %lu}",
+			(unsigned long)f->tail, (unsigned long)f->meta);
+	    }
+	    for (c = 0; counters_flag && c < PC_NB_EVENTS; c++)
+		fprintf(fp, "%s\"%s\": %.0f%s", c == 0 ? ", \"counters\": {" : "",
+			pc_names[c], stats[i].counters[c], 
+			c < PC_NB_EVENTS - 1 ? ", " : "}");
+	    if (latency_flag && stats[i].lat.worst_op >= 0)
+		fprintf(fp, ", \"latency\": {\"p50\": %.0f, \"p99\": %.0f, "
+			"\"p999\": %.0f, \"max\": %.0f, \"worst_op\": %d, "
+			"\"worst_type\": \"%c\", \"worst_size\": %d}",
+			stats[i].lat.p50, stats[i].lat.p99, stats[i].lat.p999,
+			stats[i].lat.max, stats[i].lat.worst_op, 
+			"afr"[stats[i].lat.worst_type], stats[i].lat.worst_size);
+	    fprintf(fp, "}%s\n", i < n - 1 ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+    }
+    fclose(fp);
+}
+
+/* Results of a trace in a baseline file */
+typedef struct {
+    char file[MAXLINE];
+    int valid;
+    double ops;
+    double util;
+    int runs;
+    double run_secs[MAX_RUNS];
+    double ref_secs[MAX_RUNS]; /* all 0 in files without a reference */
+} baseline_t;
+
+/*
+ * json_field - returns the text after "key": in a line, or NULL
+ */
+static char *json_field(char *line, const char *key)
+{
+    char pat[MAXLINE];
+    char *p;
+
+    sprintf(pat, "\"%s\": ", key);
+    return ((p = strstr(line, pat)) == NULL) ? NULL : p + strlen(pat);
+}
+
+/*
+ * json_array - read the numbers of a JSON array into v, up to MAX_RUNS.
+ *    Returns their number.
+ */
+static int json_array(char *q, double *v)
+{
+    char *p;
+    int n = 0;
+
+    if (q == NULL || *q++ != '[')
+	return 0;
+    while (n < MAX_RUNS && *q != ']') {
+	v[n++] = strtod(q, &p);
+	if (p == q)
+	    return n - 1;
+	q = p + strspn(p, ", ");
+    }
+    return n;
+}
+
+/*
+ * read_baseline - read the traces of a file of write_results. Returns
+ *    their number, and the traces in *base.
+ */
+static int read_baseline(char *file, baseline_t **base)
+{
+    FILE *fp;
+    char line[4 * MAXLINE];
+    char *p, *q, *field[9];
+    baseline_t *b;
+    int n = 0, k;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+	sprintf(msg, "Could not open %s", file);
+	unix_error(msg);
+    }
+    *base = NULL;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	if ((p = json_field(line, "file")) != NULL) {
+	    /* JSON trace object */
+	    if ((*base = realloc(*base, (n + 1) * sizeof(baseline_t))) == NULL)
+		unix_error("realloc failed in read_baseline");
+	    b = &(*base)[n++];
+	    for (k = 0, p++; *p && *p != '"' && k < MAXLINE - 1; p++)
+		b->file[k++] = (*p == '\\') ? *++p : *p;
+	    b->file[k] = '\0';
+	    b->valid = (q = json_field(line, "valid")) ? atoi(q) : 0;
+	    b->ops = (q = json_field(line, "ops")) ? strtod(q, NULL) : 0;
+	    b->util = (q = json_field(line, "util")) ? strtod(q, NULL) : 0;
+	    b->runs = json_array(json_field(line, "runs"), b->run_secs);
+	    memset(b->ref_secs, 0, sizeof(b->ref_secs));
+	    if (json_array(json_field(line, "ref"), b->ref_secs) != b->runs)
+		memset(b->ref_secs, 0, sizeof(b->ref_secs));
+	}
+	else if (line[0] >= '0' && line[0] <= '9') {
+	    /* CSV row: trace,file,valid,ops,util,rss_util,run,secs,ref_secs,
+	       ... */
+	    p = line;
+	    for (k = 0; k < 9; k++)
+		field[k] = strsep(&p, ",\n");
+	    if (field[8] == NULL)
+		continue;
+	    if (n == 0 || strcmp((*base)[n - 1].file, field[1]) != 0) {
+		if ((*base = realloc(*base, (n + 1) * sizeof(baseline_t))) 
+		    == NULL)
+		    unix_error("realloc failed in read_baseline");
+		b = &(*base)[n++];
+		strncpy(b->file, field[1], MAXLINE - 1);
+		b->file[MAXLINE - 1] = '\0';
+		b->valid = atoi(field[2]);
+		b->ops = strtod(field[3], NULL);
+		b->util = strtod(field[4], NULL);
+		b->runs = 0;
+	    }
+	    b = &(*base)[n - 1];
+	    if (strtod(field[7], NULL) > 0 && b->runs < MAX_RUNS) {
+		b->ref_secs[b->runs] = strtod(field[8], NULL);
+		b->run_secs[b->runs++] = strtod(field[7], NULL);
+	    }
+	}
+    }
+    fclose(fp);
+    return n;
+}
+
+/*
+ * beta_cf - continued fraction of the incomplete beta function
+ *    (Numerical Recipes, 6.4)
+ */
+static double beta_cf(double a, double b, double x)
+{
+    double c = 1, d = 1 - (a + b) * x / (a + 1), h, aa, del;
+    int m;
+
+    d = 1 / ((fabs(d) < 1e-30) ? 1e-30 : d);
+    h = d;
+    for (m = 1; m <= 300; m++) {
+	aa = m * (b - m) * x / ((a + 2*m - 1) * (a + 2*m));
+	d = 1 + aa * d;
+	d = 1 / ((fabs(d) < 1e-30) ? 1e-30 : d);
+	c = 1 + aa / c;
+	c = (fabs(c) < 1e-30) ? 1e-30 : c;
+	h *= d * c;
+	aa = -(a + m) * (a + b + m) * x / ((a + 2*m) * (a + 2*m + 1));
+	d = 1 + aa * d;
+	d = 1 / ((fabs(d) < 1e-30) ? 1e-30 : d);
+	c = 1 + aa / c;
+	c = (fabs(c) < 1e-30) ? 1e-30 : c;
+	del = d * c;
+	h *= del;
+	if (fabs(del - 1) < 1e-12)
+	    break;
+    }
+    return h;
+}
+
+/*
+ * incomplete_beta - the regularized incomplete beta function I_x(a, b)
+ */
+static double incomplete_beta(double a, double b, double x)
+{
+    double bt;
+
+    if (x <= 0)
+	return 0;
+    if (x >= 1)
+	return 1;
+    bt = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + 
+	     a * log(x) + b * log(1 - x));
+    if (x < (a + 1) / (a + b + 2))
+	return bt * beta_cf(a, b, x) / a;
+    return 1 - bt * beta_cf(b, a, 1 - x) / b;
+}
+
+/*
+ * welch_test - two-sided p-value of Welch's t-test for the means of
+ *    two samples of at least 2 values with unequal variances
+ */
+static double welch_test(double *x, int nx, double *y, int ny)
+{
+    double mx = 0, my = 0, vx = 0, vy = 0, se2, t, df;
+    int i;
+
+    for (i = 0; i < nx; i++)
+	mx += x[i] / nx;
+    for (i = 0; i < ny; i++)
+	my += y[i] / ny;
+    for (i = 0; i < nx; i++)
+	vx += (x[i] - mx) * (x[i] - mx) / (nx - 1);
+    for (i = 0; i < ny; i++)
+	vy += (y[i] - my) * (y[i] - my) / (ny - 1);
+
+    se2 = vx / nx + vy / ny;
+    if (se2 == 0)
+	return (mx == my) ? 1.0 : 0.0;
+    t = (mx - my) / sqrt(se2);
+    df = se2 * se2 / ((vx / nx) * (vx / nx) / (nx - 1) + 
+		      (vy / ny) * (vy / ny) / (ny - 1));
+    return incomplete_beta(df / 2, 0.5, df / (df + t * t));
+}
+
+/*
+ * run_kops - throughput of each run of a trace in Kops, times scale
+ */
+static void run_kops(double ops, int runs, double *secs, double scale, 
+		     double *v)
+{
+    int k;
+
+    for (k = 0; k < runs; k++)
+	v[k] = scale * ops / secs[k] / 1e3;
+}
+
+/*
+ * has_ref - is there a libc replay after each of the runs?
+ */
+static int has_ref(int runs, double *ref)
+{
+    int k;
+
+    for (k = 0; k < runs; k++)
+	if (ref[k] <= 0)
+	    return 0;
+    return runs > 0;
+}
+
+/*
+ * median_ci - median of n values, and the width of its 95% CI relative
+ *    to it (see summarize_runs)
+ */
+static double median_ci(double *v, int n, double *width)
+{
+    stats_t tmp;
+
+    memcpy(tmp.run_secs, v, n * sizeof(double));
+    summarize_runs(&tmp, n);
+    *width = (tmp.ci_hi - tmp.ci_lo) / tmp.secs;
+    return tmp.secs;
+}
+
+/*
+ * machine_drift - how much slower the machine is now than in the
+ *    baseline: the ratio of the median libc replays of a trace, or 1
+ *    if a file has none
+ */
+static double machine_drift(stats_t *stats, baseline_t *b)
+{
+    double w;
+
+    if (!has_ref(stats->runs, stats->ref_secs) || 
+	!has_ref(b->runs, b->ref_secs))
+	return 1;
+    return median_ci(stats->ref_secs, stats->runs, &w) / 
+	median_ci(b->ref_secs, b->runs, &w);
+}
+
+/*
+ * compare_results - compare the mm results with a baseline file of
+ *    write_results, trace by trace (matched by file name). A trace
+ *    regresses if it is no longer valid, if its utilization drops by
+ *    CMP_MIN_UTIL or more, or if its throughput drops significantly:
+ *
+ *    - The throughput of the runs is first scaled by machine_drift, when
+ *      both files have libc replays, so that a machine that runs slower
+ *      in this invocation than in the baseline one does not pass for a
+ *      regression.
+ *    - Welch's t-test compares the runs (2 runs or more on both sides,
+ *      -R), with Holm's correction over the tested traces: the family-
+ *      wise error rate is CMP_ALPHA.
+ *    - The drop of the median throughput must also be min_drop (-D) or
+ *      more, and larger than the 95% CI of the median on either side,
+ *      so that the two intervals are apart.
+ *
+ *    Returns the number of regressions.
+ */
+static int compare_results(char *file, char **tracefiles, int n, 
+			   stats_t *stats)
+{
+    baseline_t *base, *b, **match;
+    int num_base, i, j, m = 0, regressions = 0, bad, all_scaled = 1;
+    double x[MAX_RUNS], y[MAX_RUNS], *pval, *sorted, cut = -1;
+    double drift, mx, my, wx, wy, limit;
+    char *why;
+
+    num_base = read_baseline(file, &base);
+    if ((match = (baseline_t **)malloc(n * sizeof(baseline_t *))) == NULL ||
+	(pval = (double *)malloc(n * sizeof(double))) == NULL ||
+	(sorted = (double *)malloc(n * sizeof(double))) == NULL)
+	unix_error("malloc failed in compare_results");
+
+    /* The p-values of all traces first, for Holm's correction: the k-th
+       smallest of m is significant if it and all the smaller ones are
+       below CMP_ALPHA / (m - k) */
+    for (i = 0; i < n; i++) {
+	for (j = 0, b = NULL; j < num_base && b == NULL; j++)
+	    if (strcmp(base[j].file, tracefiles[i]) == 0)
+		b = &base[j];
+	match[i] = b;
+	pval[i] = -1;
+	if (b == NULL || !stats[i].valid || !b->valid || 
+	    stats[i].runs < 2 || b->runs < 2)
+	    continue;
+	all_scaled &= has_ref(stats[i].runs, stats[i].ref_secs) && 
+	    has_ref(b->runs, b->ref_secs);
+	run_kops(stats[i].ops, stats[i].runs, stats[i].run_secs, 
+		 machine_drift(&stats[i], b), x);
+	run_kops(b->ops, b->runs, b->run_secs, 1, y);
+	sorted[m++] = pval[i] = welch_test(x, stats[i].runs, y, b->runs);
+    }
+    qsort(sorted, m, sizeof(double), cmp_double);
+    for (j = 0; j < m && sorted[j] <= CMP_ALPHA / (m - j); j++)
+	cut = sorted[j];
+
+    printf("Comparison with %s%s:\n", file, 
+	   (m > 0 && all_scaled) ? " (change for the speed of libc malloc)" : "");
+    printf("%5s%7s%7s%9s%9s%9s%8s%8s\n", 
+	   "trace", "util", "base", "Kops", "base", "change", "limit", "p");
+    for (i = 0; i < n; i++) {
+	b = match[i];
+	if (b == NULL) {
+	    printf("%2d  not in the baseline\n", i);
+	    continue;
+	}
+	if (!stats[i].valid || !b->valid) {
+	    bad = b->valid;
+	    printf("%2d  %s%s\n", i, stats[i].valid ? "valid" : "invalid", 
+		   bad ? ", REGRESSION" : " (invalid in the baseline)");
+	    regressions += bad;
+	    continue;
+	}
+
+	bad = stats[i].util <= b->util - CMP_MIN_UTIL;
+	why = bad ? "util" : "";
+	printf("%2d%9.1f%%%6.1f%%", i, stats[i].util * 100, b->util * 100);
+	if (stats[i].runs == 0 || b->runs == 0) {
+	    printf("%9s%9s%9s%8s%8s", "-", "-", "-", "-", "-");
+	}
+	else {
+	    drift = machine_drift(&stats[i], b);
+	    run_kops(stats[i].ops, stats[i].runs, stats[i].run_secs, drift, x);
+	    run_kops(b->ops, b->runs, b->run_secs, 1, y);
+	    mx = median_ci(x, stats[i].runs, &wx);
+	    my = median_ci(y, b->runs, &wy);
+	    printf("%9.0f%9.0f", mx / drift, my);
+	    limit = min_drop;
+	    if (wx > limit)
+		limit = wx;
+	    if (wy > limit)
+		limit = wy;
+	    printf("%+8.1f%%%7.1f%%", (mx / my - 1) * 100, limit * 100);
+	    if (pval[i] >= 0) {
+		printf("%8.3f", pval[i]);
+		if (pval[i] <= cut && mx <= my * (1 - limit)) {
+		    why = bad ? "util, throughput" : "throughput";
+		    bad = 1;
+		}
+	    }
+	    else
+		printf("%8s", "-");
+	}
+	if (bad)
+	    printf("  REGRESSION (%s)", why);
+	printf("\n");
+	regressions += bad;
+    }
+    printf("%d regression%s\n\n", regressions, regressions == 1 ? "" : "s");
+    free(base);
+    free(match);
+    free(pval);
+    free(sorted);
+    return regressions;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +3091,40 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValscFWL] [-f <file>] [-t <dir>] [-A <n>] [-O <n>]\n");
+    fprintf(stderr, "               [-H <size>] [-T <policy>] [-S <cost>]\n");
+    fprintf(stderr, "               [-j <n> [-P]] [-u <n> [-U <file>]]\n");
+    fprintf(stderr, "               [-R <n>] [-o <file>] [-C <file> [-D <pct>]]\n");
+    fprintf(stderr, "               [-w <n>] [-e <pct> [-b <secs>]] [-k <cpu>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A <n>     Also replay with arenas for phases of <n> ops.\n");
+    fprintf(stderr, "\t-b <secs>  Time budget of the runs of a trace with -e (default 10).\n");
+    fprintf(stderr, "\t-c         Count hardware events (cycles, misses...) per op.\n");
+    fprintf(stderr, "\t-C <file>  Compare with the results of <file>; exit status 2 on regressions.\n");
+    fprintf(stderr, "\t-D <pct>   Smallest throughput drop that -C flags (default 10).\n");
+    fprintf(stderr, "\t-e <pct>   Repeat the runs until the 95%% CI of the median is within <pct>%%.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F         Break down the heap at the peak of every trace.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate the traces in <n> processes (timing stays serial).\n");
+    fprintf(stderr, "\t-k <cpu>   Pin the driver to CPU <cpu>.\n");
+    fprintf(stderr, "\t-H <size>  Size of the simulated heap (e.g. 512M, 8G).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Time every request on its own (percentiles, slowest request).\n");
+    fprintf(stderr, "\t-O <n>     Also replay with object pools for requests of up to <n> bytes.\n");
+    fprintf(stderr, "\t-o <file>  Write the results to <file> (CSV if it ends with .csv, else JSON).\n");
+    fprintf(stderr, "\t-P         With -j, time the traces in parallel too.\n");
+    fprintf(stderr, "\t-R <n>     Time every trace <n> times (median, MAD, CI with -v).\n");
+    fprintf(stderr, "\t-s         Stream the traces instead of loading them.\n");
+    fprintf(stderr, "\t-S <cost>  Cost of mem_sbrk: none, mprotect, spin:<call ns>:<page ns>.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <pol>   Huge pages: 0 none, 1 madvise, 2 madvise + 2MB-aligned heap.\n");
+    fprintf(stderr, "\t-u <n>     Sample the heap every <n> ops of the utilization pass.\n");
+    fprintf(stderr, "\t-U <file>  CSV file of the heap samples (default util.csv).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-W         Also time the traces with the caches evicted before each replay.\n");
+    fprintf(stderr, "\t-w <n>     Untimed replays before the runs of a trace (default 1).\n");
 }
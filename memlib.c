@@ -2,36 +2,212 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ * The simulated heap is a region of address space reserved with mmap and
+ * MAP_NORESERVE, so its size costs nothing until the pages are touched. The
+ * size is MAX_HEAP by default; it can be set with mem_set_max_heap or with
+ * the MEM_HEAP_SIZE environment variable (e.g. "8G"). The region can also
+ * be backed by transparent huge pages (mem_set_hugepages or MEM_HUGEPAGES).
+ *
+ * Since the region is reserved lazily, only the pages that were touched
+ * are resident: mem_resident counts them with mincore, and
+ * mem_release_pages gives the pages above brk back to the system so
+ * that the next run starts from an untouched heap.
+ *
+ * By default mem_sbrk only bumps a pointer. A cost model (mem_set_cost_model
+ * or the MEM_SBRK_COST environment variable) makes heap growth cost what
+ * it costs to a real process: "spin:<sbrk ns>:<page ns>" busy-waits for a
+ * fixed time per call and per page the brk crosses, and "mprotect" maps
+ * the heap with PROT_NONE, makes each sbrk an mprotect system call and
+ * releases the pages on reset, so that every run pays for its page faults.
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* Alignment of the heap start for MEM_HUGE_ALIGNED */
+#define HUGE_PAGE_SIZE (2*(1<<20))
+
+/* Rounds an address up to a page boundary */
+#define PAGE_UP(p, pagesize) \
+    ((char *)(((uintptr_t)(p) + (pagesize) - 1) & ~(uintptr_t)((pagesize) - 1)))
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
 
+static char *mem_map_start;  /* mapped region that contains the heap... */
+static size_t mem_map_size;  /* ... and its size */
+static char *mem_top_brk;    /* highest brk since the last page release */
+
+/* configuration, 0 means "not set by the caller" */
+static size_t mem_max_heap = 0;
+static int mem_hugepages = -1;
+static int mem_cost_model = -1;     /* MEM_COST_xxx... */
+static long mem_sbrk_ns;            /* ... its latency per sbrk call ... */
+static long mem_page_ns;            /* ... and per page crossed by the brk */
+
+/*
+ * mem_parse_size - parse a byte count with an optional K, M or G suffix.
+ *    Returns 0 if str is not a valid size.
+ */
+size_t mem_parse_size(const char *str)
+{
+    char *end;
+    unsigned long long size = strtoull(str, &end, 10);
+
+    switch (*end) {
+    case 'g': case 'G': size <<= 10; /* fall through */
+    case 'm': case 'M': size <<= 10; /* fall through */
+    case 'k': case 'K': size <<= 10; end++; break;
+    case '\0': break;
+    default: return 0;
+    }
+    if (*end != '\0' || size != (size_t)size)
+	return 0;
+    return (size_t)size;
+}
+
+/*
+ * parse_cost_model - parse "none", "mprotect" or "spin:<sbrk ns>:<page ns>".
+ *    Returns -1 if spec is not a valid cost model.
+ */
+static int parse_cost_model(const char *spec, int *model, 
+			    long *sbrk_ns, long *page_ns)
+{
+    char *end;
+
+    *sbrk_ns = *page_ns = 0;
+    if (!strcmp(spec, "none")) {
+	*model = MEM_COST_NONE;
+	return 0;
+    }
+    if (!strcmp(spec, "mprotect")) {
+	*model = MEM_COST_MPROTECT;
+	return 0;
+    }
+    if (strncmp(spec, "spin:", 5) != 0)
+	return -1;
+    *model = MEM_COST_SPIN;
+    *sbrk_ns = strtol(spec + 5, &end, 10);
+    if (*end != ':' || *sbrk_ns < 0)
+	return -1;
+    *page_ns = strtol(end + 1, &end, 10);
+    if (*end != '\0' || *page_ns < 0)
+	return -1;
+    return 0;
+}
+
+/*
+ * mem_spin - busy-wait for ns nanoseconds
+ */
+static void mem_spin(long ns)
+{
+    struct timespec t0, t;
+
+    if (ns <= 0)
+	return;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do
+	clock_gettime(CLOCK_MONOTONIC, &t);
+    while ((long long)(t.tv_sec - t0.tv_sec) * 1000000000LL +
+	   (t.tv_nsec - t0.tv_nsec) < ns);
+}
+
+/*
+ * mem_set_cost_model - set the cost model of sbrk (see the top of this
+ *    file). Returns -1 if spec is not valid.
+ */
+int mem_set_cost_model(const char *spec)
+{
+    return parse_cost_model(spec, &mem_cost_model, &mem_sbrk_ns, &mem_page_ns);
+}
+
+/*
+ * mem_set_max_heap - set the size of the simulated heap
+ */
+void mem_set_max_heap(size_t bytes)
+{
+    mem_max_heap = bytes;
+}
+
+/*
+ * mem_set_hugepages - set the huge page policy (MEM_HUGE_xxx)
+ */
+void mem_set_hugepages(int policy)
+{
+    mem_hugepages = policy;
+}
+
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    char *env;
+    size_t max_heap = mem_max_heap;
+    int hugepages = mem_hugepages;
+
+    /* settings of the caller take precedence over the environment */
+    if (max_heap == 0 && (env = getenv("MEM_HEAP_SIZE")) != NULL) {
+	if ((max_heap = mem_parse_size(env)) == 0) {
+	    fprintf(stderr, "mem_init: bad MEM_HEAP_SIZE \"%s\"\n", env);
+	    exit(1);
+	}
+    }
+    if (max_heap == 0)
+	max_heap = MAX_HEAP;
+    if (hugepages < 0) 
+	hugepages = ((env = getenv("MEM_HUGEPAGES")) != NULL) ? atoi(env) : 0;
+    if (mem_cost_model < 0) {
+	mem_cost_model = MEM_COST_NONE;
+	if ((env = getenv("MEM_SBRK_COST")) != NULL &&
+	    parse_cost_model(env, &mem_cost_model, 
+			     &mem_sbrk_ns, &mem_page_ns) < 0) {
+	    fprintf(stderr, "mem_init: bad MEM_SBRK_COST \"%s\"\n", env);
+	    exit(1);
+	}
+    }
+
+    /* reserve the address space we will use to model the available VM */
+    mem_map_size = max_heap;
+    if (hugepages == MEM_HUGE_ALIGNED)
+	mem_map_size += HUGE_PAGE_SIZE;
+    mem_map_start = mmap(NULL, mem_map_size, 
+			 (mem_cost_model == MEM_COST_MPROTECT) ?
+			 PROT_NONE : PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_map_start == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error (%lu bytes): %s\n",
+		(unsigned long)mem_map_size, strerror(errno));
 	exit(1);
     }
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+    mem_start_brk = mem_map_start;
+    if (hugepages == MEM_HUGE_ALIGNED) {
+	mem_start_brk = (char *)(((uintptr_t)mem_map_start + HUGE_PAGE_SIZE - 1)
+				 & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugepages != MEM_HUGE_NONE &&
+	madvise(mem_start_brk, max_heap, MADV_HUGEPAGE) < 0)
+	fprintf(stderr, "mem_init_vm: madvise(MADV_HUGEPAGE): %s\n",
+		strerror(errno));
+#endif
+
+    mem_max_addr = mem_start_brk + max_heap;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_top_brk = mem_brk;
 }
 
 /* 
@@ -39,15 +215,27 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_map_start, mem_map_size);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    With the mprotect cost model, the pages of the heap are also released
+ *    and made inaccessible again.
  */
 void mem_reset_brk()
 {
+    size_t len;
+
     mem_brk = mem_start_brk;
+    if (mem_cost_model == MEM_COST_MPROTECT) {
+	len = PAGE_UP(mem_top_brk, mem_pagesize()) - mem_start_brk;
+	if (len > 0 && 
+	    (madvise(mem_start_brk, len, MADV_DONTNEED) < 0 ||
+	     mprotect(mem_start_brk, len, PROT_NONE) < 0))
+	    fprintf(stderr, "mem_reset_brk: %s\n", strerror(errno));
+	mem_top_brk = mem_brk;
+    }
 }
 
 /* 
@@ -55,19 +243,78 @@ void mem_reset_brk()
  *    by incr bytes and returns the start address of the new area. In
  *    this model, the heap cannot be shrunk.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
     char *old_brk = mem_brk;
+    size_t pagesize = mem_pagesize();
+    char *lo, *hi;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ( (incr < 0) || (incr > mem_max_addr - mem_brk)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+
+    /* charge the cost of the system call and of the new pages */
+    lo = PAGE_UP(old_brk, pagesize);
+    hi = PAGE_UP(mem_brk, pagesize);
+    switch (mem_cost_model) {
+    case MEM_COST_SPIN:
+	mem_spin(mem_sbrk_ns + mem_page_ns * (long)((hi - lo) / pagesize));
+	break;
+    case MEM_COST_MPROTECT:
+	if (mprotect(lo, hi - lo, PROT_READ | PROT_WRITE) < 0) {
+	    fprintf(stderr, "ERROR: mem_sbrk failed. mprotect: %s\n", 
+		    strerror(errno));
+	    mem_brk = old_brk;
+	    return (void *)-1;
+	}
+	break;
+    }
+    if (mem_brk > mem_top_brk)
+	mem_top_brk = mem_brk;
     return (void *)old_brk;
 }
 
+/*
+ * mem_release_pages - give the pages that lie entirely above brk back to
+ *    the system (they read as zeros when touched again)
+ */
+void mem_release_pages()
+{
+    char *lo = PAGE_UP(mem_brk, mem_pagesize());
+
+    if (mem_top_brk > lo &&
+	madvise(lo, mem_top_brk - lo, MADV_DONTNEED) < 0)
+	fprintf(stderr, "mem_release_pages: madvise: %s\n", strerror(errno));
+    mem_top_brk = mem_brk;
+}
+
+/*
+ * mem_resident - returns the number of bytes in the resident pages of
+ *    the heap. The heap never shrinks, so this is also the peak resident
+ *    size since the last page release. If mincore is not available, every
+ *    page below the highest brk counts as resident.
+ */
+size_t mem_resident()
+{
+    size_t pagesize = mem_pagesize();
+    size_t npages = (mem_top_brk - mem_start_brk + pagesize - 1) / pagesize;
+    size_t resident = 0;
+    size_t i, j, n;
+    unsigned char vec[4096];
+
+    for (i = 0; i < npages; i += n) {
+	n = (npages - i < sizeof(vec)) ? npages - i : sizeof(vec);
+	if (mincore(mem_start_brk + i*pagesize, n*pagesize, vec) < 0)
+	    return npages * pagesize;
+	for (j = 0; j < n; j++)
+	    resident += vec[j] & 1;
+    }
+    return resident * pagesize;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
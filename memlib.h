@@ -1,11 +1,29 @@
 #include <unistd.h>
+#include <stdint.h>
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+void mem_release_pages(void);     /* release the pages above brk */
+size_t mem_resident(void);        /* bytes in the touched heap pages */
 
+/* Huge page policies of the simulated heap (see mem_set_hugepages) */
+#define MEM_HUGE_NONE    0  /* regular pages */
+#define MEM_HUGE_ADVISE  1  /* madvise(MADV_HUGEPAGE) on the region */
+#define MEM_HUGE_ALIGNED 2  /* same, with the heap start aligned to 2 MB */
+
+/* Cost models of mem_sbrk (see mem_set_cost_model) */
+#define MEM_COST_NONE     0  /* sbrk only bumps a pointer */
+#define MEM_COST_SPIN     1  /* busy-wait per sbrk call and per new page */
+#define MEM_COST_MPROTECT 2  /* mprotect per sbrk, page faults on each run */
+
+/* Configuration, to be called before mem_init */
+void mem_set_max_heap(size_t bytes);
+void mem_set_hugepages(int policy);
+int mem_set_cost_model(const char *spec);
+size_t mem_parse_size(const char *str);
@@ -0,0 +1,13 @@
+/*
+ * Payload alignment of mm_malloc, shared by mm.c and the allocators built
+ * on top of it, which the Makefile compiles with the same MMFLAGS as mm.o.
+ * libmm.so is built with -DMM_ALIGNMENT=16, the alignment that malloc
+ * guarantees on x86-64.
+ */
+#ifndef MM_ALIGNMENT
+#define MM_ALIGNMENT 8
+#endif
+#define ALIGNMENT MM_ALIGNMENT
+
+/* rounds up to the nearest multiple of ALIGNMENT */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
@@ -0,0 +1,127 @@
+// mm-arena.c
+
+// Arenas for phase-structured allocation. An arena owns a list of chunks
+// obtained with mm_malloc, and allocates from the current chunk by bumping a
+// pointer. Objects are never freed individually: mm_arena_reset rewinds the
+// arena to its first chunk (keeping the chunks for the next phase) and
+// mm_arena_destroy gives every chunk back to mm_free.
+
+// Requests larger than the chunk size get a dedicated chunk of their own.
+// Such chunks are kept in a separate list and are freed on reset, so that
+// one large object doesn't pin memory for the following phases.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+#include "mm-align.h"
+#include "mm-arena.h"
+
+// default usable size of a chunk
+#define ARENA_CHUNK_SIZE 4096
+
+// chunk header, the payload follows it
+typedef struct arena_chunk {
+  struct arena_chunk* next;
+  size_t size;
+} arena_chunk_t;
+
+#define CHUNK_HDR_SIZE ALIGN(sizeof(arena_chunk_t))
+
+// returns the first payload byte of chunk c
+#define CHUNK_BEGIN(c) ((char*)(c) + CHUNK_HDR_SIZE)
+
+struct mm_arena {
+  arena_chunk_t* chunks;   // chunks of chunk_size bytes, in allocation order
+  arena_chunk_t* current;  // chunk that is being filled
+  arena_chunk_t* large;    // dedicated chunks of oversized requests
+  char* ptr;               // next free byte of the current chunk
+  char* end;               // end of the current chunk
+  size_t chunk_size;
+};
+
+// allocates a chunk of size usable bytes with mm_malloc
+static arena_chunk_t* new_chunk(size_t size) {
+  arena_chunk_t* c = (arena_chunk_t*)mm_malloc(CHUNK_HDR_SIZE + size);
+  if (c == NULL)
+    return NULL;
+  c->next = NULL;
+  c->size = size;
+  return c;
+}
+
+// makes chunk c the current one
+static void use_chunk(mm_arena_t* arena, arena_chunk_t* c) {
+  arena->current = c;
+  arena->ptr = CHUNK_BEGIN(c);
+  arena->end = CHUNK_BEGIN(c) + c->size;
+}
+
+mm_arena_t* mm_arena_create(size_t chunk_size) {
+  mm_arena_t* arena = (mm_arena_t*)mm_malloc(sizeof(mm_arena_t));
+  if (arena == NULL)
+    return NULL;
+
+  arena->chunk_size = ALIGN(chunk_size ? chunk_size : ARENA_CHUNK_SIZE);
+  arena->large = NULL;
+  arena->chunks = new_chunk(arena->chunk_size);
+  if (arena->chunks == NULL) {
+    mm_free(arena);
+    return NULL;
+  }
+  use_chunk(arena, arena->chunks);
+  return arena;
+}
+
+// Bump pointer allocation. When the current chunk is full, the arena moves to
+// the next chunk kept from a previous phase, or appends a new one.
+void* mm_arena_alloc(mm_arena_t* arena, size_t size) {
+  size = ALIGN(size);
+
+  if (size > arena->chunk_size) {
+    arena_chunk_t* c = new_chunk(size);
+    if (c == NULL)
+      return NULL;
+    c->next = arena->large;
+    arena->large = c;
+    return CHUNK_BEGIN(c);
+  }
+
+  if ((size_t)(arena->end - arena->ptr) < size) {
+    arena_chunk_t* c = arena->current->next;
+    if (c == NULL) {
+      if ((c = new_chunk(arena->chunk_size)) == NULL)
+        return NULL;
+      arena->current->next = c;
+    }
+    use_chunk(arena, c);
+  }
+
+  void* p = arena->ptr;
+  arena->ptr += size;
+  return p;
+}
+
+// Frees every object of the arena at once
+void mm_arena_reset(mm_arena_t* arena) {
+  arena_chunk_t* c = arena->large;
+  while (c != NULL) {
+    arena_chunk_t* next = c->next;
+    mm_free(c);
+    c = next;
+  }
+  arena->large = NULL;
+  use_chunk(arena, arena->chunks);
+}
+
+void mm_arena_destroy(mm_arena_t* arena) {
+  mm_arena_reset(arena);
+  arena_chunk_t* c = arena->chunks;
+  while (c != NULL) {
+    arena_chunk_t* next = c->next;
+    mm_free(c);
+    c = next;
+  }
+  mm_free(arena);
+}
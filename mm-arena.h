@@ -0,0 +1,14 @@
+#include <stdio.h>
+
+/*
+ * Region (arena) allocator on top of mm_malloc: objects are carved from
+ * chunks with a bump pointer and are never freed one by one; all of them
+ * die at once when the arena is reset or destroyed.
+ */
+typedef struct mm_arena mm_arena_t;
+
+/* chunk_size == 0 selects ARENA_CHUNK_SIZE */
+extern mm_arena_t *mm_arena_create(size_t chunk_size);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
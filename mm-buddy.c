@@ -0,0 +1,478 @@
+// mm-buddy.c
+
+// Binary buddy allocator, an alternative engine to the segregated fit
+// allocator of mm.c with the same interface. The Makefile links it into
+// mdriver-buddy, so that both engines can be compared on the same traces.
+
+// Every block has a size of 2^k bytes (MIN_ORDER <= k <= MAX_ORDER) and its
+// offset from the heap base is a multiple of its size, so the buddy of the
+// block at offset off is simply at off ^ 2^k. Blocks carry no header: the
+// order of allocated blocks is kept in a side table with one byte per
+// minimum block, and for every order a free-area bitmap has a bit set for
+// each free block of this order. Free blocks of each order are also linked in
+// a doubly linked list through their payloads.
+
+// The side table and the bitmaps cover the heap up to a capacity (a power of
+// two), and live in two blocks of the heap itself, so they count in its size:
+// the table takes capacity/16 bytes, and the bitmaps of all orders, packed
+// bit after bit, capacity/64 bytes. When the heap outgrows them, they move to
+// new blocks placed after the new end of the heap, and the old ones are freed.
+
+// The heap is not reserved at once: it grows with mem_sbrk when no free block
+// is large enough, and the new block is placed at the first offset aligned to
+// its size (the gap in front of it becomes free blocks of smaller orders).
+
+// Function realloc shrinks blocks in place by splitting off their upper
+// halves, and grows them in place if the block is the lower buddy at every
+// order up to the required one and all the upper buddies are free (or lie
+// beyond the end of the heap, which is then extended).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+team_t team = {
+    /* Team name */
+    "ateam",
+    /* First member's full name */
+    "Nikita Matckevich",
+    /* First member's email address */
+    "nikita.matckevich@ensta-paris.fr",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""
+};
+
+// smallest block holds two pointers and keeps payloads aligned to 16 bytes
+#define MIN_ORDER 4
+// largest block, and maximal heap size of this engine: 32 MB
+#define MAX_ORDER 25
+#define NB_ORDERS (MAX_ORDER - MIN_ORDER + 1)
+
+// smallest capacity of the tables
+#define MIN_CAPACITY BLOCK_SIZE(MIN_ORDER + 10)
+
+// returns the address that lies in len bytes before or after ptr
+#define OFFSET(ptr, len) (void*)((char*)(ptr) + (len))
+
+#define BLOCK_SIZE(k) ((size_t)1 << (k))
+
+// free block links, stored at the beginning of the block
+typedef struct free_block {
+  struct free_block* next;
+  struct free_block* prev;
+} free_block_t;
+
+// first byte of the heap managed by the engine, and offset of its end
+static char*  base;
+static size_t top;
+
+// free lists and free-area bitmaps of each order, map_first[k] is the index
+// of the first bitmap bit of order MIN_ORDER + k
+static free_block_t* free_lists[NB_ORDERS];
+static uint32_t*     free_map;
+static size_t        map_first[NB_ORDERS];
+
+// order of the allocated block that begins at each minimum block, 0 if no
+// allocated block begins there
+static unsigned char* block_order;
+
+// offsets covered by the tables, and the blocks of the order table and of
+// the bitmaps
+static size_t meta_cap;
+static size_t meta_off[2];
+static int    meta_order[2];
+
+// heap consistency checker
+void mm_check(void);
+
+// returns the smallest order whose blocks hold size bytes
+static int order_of(size_t size) {
+  int k = MIN_ORDER;
+  while (k <= MAX_ORDER && BLOCK_SIZE(k) < size) {
+    ++k;
+  }
+  return k;
+}
+
+static int test_bit(int k, size_t off) {
+  size_t i = map_first[k - MIN_ORDER] + (off >> k);
+  return (free_map[i / 32] >> (i % 32)) & 1;
+}
+
+static void set_bit(int k, size_t off) {
+  size_t i = map_first[k - MIN_ORDER] + (off >> k);
+  free_map[i / 32] |= (uint32_t)1 << (i % 32);
+}
+
+static void clear_bit(int k, size_t off) {
+  size_t i = map_first[k - MIN_ORDER] + (off >> k);
+  free_map[i / 32] &= ~((uint32_t)1 << (i % 32));
+}
+
+// is the block at offset off one of the blocks of the tables?
+static int is_meta(size_t off) {
+  return meta_cap > 0 && (off == meta_off[0] || off == meta_off[1]);
+}
+
+// pushes the free block at offset off to the list of order k
+static void push_free(int k, size_t off) {
+  free_block_t* b = (free_block_t*)(base + off);
+  b->prev = NULL;
+  b->next = free_lists[k - MIN_ORDER];
+  if (b->next != NULL)
+    b->next->prev = b;
+  free_lists[k - MIN_ORDER] = b;
+  set_bit(k, off);
+}
+
+// removes the free block at offset off from the list of order k
+static void remove_free(int k, size_t off) {
+  free_block_t* b = (free_block_t*)(base + off);
+  if (b->prev == NULL)
+    free_lists[k - MIN_ORDER] = b->next;
+  else
+    b->prev->next = b->next;
+  if (b->next != NULL)
+    b->next->prev = b->prev;
+  clear_bit(k, off);
+}
+
+// Frees the block of order k at offset off, merging it with its buddy as
+// long as the buddy is free
+static void release(int k, size_t off) {
+  while (k < MAX_ORDER) {
+    size_t buddy = off ^ BLOCK_SIZE(k);
+    if (buddy + BLOCK_SIZE(k) > top || !test_bit(k, buddy))
+      break;
+    remove_free(k, buddy);
+    off &= ~BLOCK_SIZE(k);
+    ++k;
+  }
+  push_free(k, off);
+}
+
+// Frees the area from top to off with the largest aligned blocks that fit in
+// it, and moves top to off
+static void release_gap(size_t off) {
+  while (top < off) {
+    int j = MIN_ORDER;
+    while ((top & BLOCK_SIZE(j)) == 0 && top + BLOCK_SIZE(j + 1) <= off)
+      ++j;
+    size_t gap = top;
+    top += BLOCK_SIZE(j);
+    release(j, gap);
+  }
+}
+
+// Moves the tables to two new blocks placed after offset end, with the
+// smallest capacity that covers them. Returns -1 if the heap is full.
+static int move_meta(size_t end) {
+  size_t cap = MIN_CAPACITY;
+  size_t off[2];
+  int m[2];
+  for (;;) {
+    m[0] = order_of(cap >> MIN_ORDER);
+    m[1] = m[0] - 2;
+    off[0] = (end + BLOCK_SIZE(m[0]) - 1) & ~(BLOCK_SIZE(m[0]) - 1);
+    off[1] = off[0] + BLOCK_SIZE(m[0]);
+    if (off[1] + BLOCK_SIZE(m[1]) <= cap)
+      break;
+    if (cap == BLOCK_SIZE(MAX_ORDER))
+      return -1;
+    cap *= 2;
+  }
+  if (mem_sbrk(off[1] + BLOCK_SIZE(m[1]) - top) == (void*)-1)
+    return -1;
+
+  // copy the order table, and set the bits of the free blocks in the new
+  // bitmaps (the bits of order k begin after the cap >> j bits of each
+  // order j < k, cap/8 bits in all)
+  unsigned char* order = (unsigned char*)(base + off[0]);
+  memset(order, 0, BLOCK_SIZE(m[0]));
+  if (meta_cap > 0)
+    memcpy(order, block_order, meta_cap >> MIN_ORDER);
+  block_order = order;
+  free_map = (uint32_t*)(base + off[1]);
+  memset(free_map, 0, BLOCK_SIZE(m[1]));
+  size_t bits = 0;
+  for (int k = MIN_ORDER; k <= MAX_ORDER; ++k) {
+    map_first[k - MIN_ORDER] = bits;
+    bits += cap >> k;
+    for (free_block_t* b = free_lists[k - MIN_ORDER]; b; b = b->next)
+      set_bit(k, (char*)b - base);
+  }
+
+  size_t old_cap = meta_cap;
+  size_t old_off[2] = { meta_off[0], meta_off[1] };
+  int old_order[2] = { meta_order[0], meta_order[1] };
+  meta_cap = cap;
+  for (int i = 0; i < 2; ++i) {
+    meta_off[i] = off[i];
+    meta_order[i] = m[i];
+    block_order[off[i] >> MIN_ORDER] = m[i];
+  }
+
+  // the area [end, off[0]) is free, the old tables once they are unused
+  size_t start = top;
+  top = end;
+  release_gap(off[0]);
+  top = start;
+  for (int i = 0; old_cap > 0 && i < 2; ++i) {
+    block_order[old_off[i] >> MIN_ORDER] = 0;
+    release(old_order[i], old_off[i]);
+  }
+  return 0;
+}
+
+// Extends the heap up to offset end with a new area that begins at offset
+// off: the gap from top to off is freed, and the area itself is left to the
+// caller. Returns -1 if the heap is full.
+static int extend(size_t off, size_t end) {
+  size_t top_end = end;
+  if (end > meta_cap) {
+    if (move_meta(end) < 0)
+      return -1;
+    top_end = meta_off[1] + BLOCK_SIZE(meta_order[1]);
+  } else if (mem_sbrk(end - top) == (void*)-1) {
+    return -1;
+  }
+  release_gap(off);
+  top = top_end;
+  return 0;
+}
+
+// Extends the heap with a block of order k placed at the first offset aligned
+// to its size. Returns the offset of the block, or -1 if the heap is full.
+static long grow(int k) {
+  size_t off = (top + BLOCK_SIZE(k) - 1) & ~(BLOCK_SIZE(k) - 1);
+  if (off + BLOCK_SIZE(k) > BLOCK_SIZE(MAX_ORDER))
+    return -1;
+  if (extend(off, off + BLOCK_SIZE(k)) < 0)
+    return -1;
+  return (long)off;
+}
+
+// Takes a block of order k: the smallest free block of order >= k, split down
+// to order k, or a new block at the end of the heap
+static long take(int k) {
+  int j = k;
+  while (j <= MAX_ORDER && free_lists[j - MIN_ORDER] == NULL)
+    ++j;
+  if (j > MAX_ORDER)
+    return grow(k);
+
+  size_t off = (char*)free_lists[j - MIN_ORDER] - base;
+  remove_free(j, off);
+  while (j > k) {
+    --j;
+    push_free(j, off + BLOCK_SIZE(j));
+  }
+  return (long)off;
+}
+
+// Checks that the free lists and the free-area bitmaps agree
+void mm_check(void) {
+  for (int k = MIN_ORDER; k <= MAX_ORDER; ++k) {
+    size_t n = 0;
+    for (free_block_t* b = free_lists[k - MIN_ORDER]; b; b = b->next) {
+      size_t off = (char*)b - base;
+      if ((off & (BLOCK_SIZE(k) - 1)) != 0 || off + BLOCK_SIZE(k) > top) {
+        printf("free block %p of order %d is misplaced\n", (void*)b, k);
+        exit(8);
+      }
+      if (!test_bit(k, off)) {
+        printf("free block %p of order %d is not in the bitmap\n", (void*)b, k);
+        exit(8);
+      }
+      size_t buddy = off ^ BLOCK_SIZE(k);
+      if (k < MAX_ORDER && buddy + BLOCK_SIZE(k) <= top && test_bit(k, buddy)) {
+        printf("free buddies %p of order %d escaped merging\n", (void*)b, k);
+        exit(8);
+      }
+      n++;
+    }
+    size_t bits = 0;
+    for (size_t i = 0; i < (top >> k); ++i)
+      bits += test_bit(k, i << k);
+    if (bits != n) {
+      printf("bitmap of order %d has %lu bits for %lu free blocks\n", k,
+             (unsigned long)bits, (unsigned long)n);
+      exit(8);
+    }
+  }
+}
+
+// mm_stats - walks the blocks from the heap base: an allocated block is
+// recognized by its order in block_order, a free one by its bitmap bit. The
+// alignment padding in front of the base and the blocks of the tables count
+// as used bytes. There is one free list per order.
+void mm_stats(mm_stats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->heap_bytes = mem_heapsize();
+  stats->used_bytes = base - (char*)mem_heap_lo();
+
+  size_t off = 0;
+  while (off < top) {
+    int k = block_order[off >> MIN_ORDER];
+    if (is_meta(off)) {
+      stats->used_bytes += BLOCK_SIZE(k);
+    } else if (k != 0) {
+      stats->used_bytes += BLOCK_SIZE(k);
+      stats->nb_used++;
+    } else {
+      k = MIN_ORDER;
+      while (k < MAX_ORDER && !test_bit(k, off))
+        ++k;
+      stats->free_bytes += BLOCK_SIZE(k);
+      stats->nb_free++;
+      if (BLOCK_SIZE(k) > stats->largest_free)
+        stats->largest_free = BLOCK_SIZE(k);
+    }
+    off += BLOCK_SIZE(k);
+  }
+
+  stats->nb_lists = NB_ORDERS;
+  for (int k = 0; k < NB_ORDERS; ++k)
+    for (free_block_t* b = free_lists[k]; b; b = b->next)
+      stats->list_len[k]++;
+}
+
+// mm_heap_walk - walks the blocks like mm_stats. Blocks have no header, so
+// the padding in front of the base and the blocks of the tables are the only
+// metadata in the heap.
+void mm_heap_walk(mm_walk_fn fn, void* arg) {
+  fn(arg, MM_WALK_META, mem_heap_lo(), base - (char*)mem_heap_lo(), NULL, 0);
+
+  size_t off = 0;
+  while (off < top) {
+    int k = block_order[off >> MIN_ORDER];
+    if (is_meta(off)) {
+      fn(arg, MM_WALK_META, base + off, BLOCK_SIZE(k), NULL, 0);
+    } else if (k != 0) {
+      fn(arg, MM_WALK_USED, base + off, BLOCK_SIZE(k), base + off,
+         BLOCK_SIZE(k));
+    } else {
+      k = MIN_ORDER;
+      while (k < MAX_ORDER && !test_bit(k, off))
+        ++k;
+      fn(arg, MM_WALK_FREE, base + off, BLOCK_SIZE(k), NULL, 0);
+    }
+    off += BLOCK_SIZE(k);
+  }
+}
+
+// mm_init - initialize the buddy allocator. The heap base is the current brk
+// rounded up to the minimum block size; the tables are created by the first
+// extension of the heap.
+int mm_init(void) {
+  memset(free_lists, 0, sizeof(free_lists));
+  block_order = NULL;
+  free_map = NULL;
+  meta_cap = 0;
+
+  char* brk = mem_sbrk(0);
+  size_t pad = (BLOCK_SIZE(MIN_ORDER) - (uintptr_t)brk % BLOCK_SIZE(MIN_ORDER))
+               % BLOCK_SIZE(MIN_ORDER);
+  if (pad > 0 && mem_sbrk(pad) == (void*)-1)
+    return -1;
+  base = brk + pad;
+  top = 0;
+  return 0;
+}
+
+// mm_malloc - Allocate a block of the smallest order that holds size bytes
+void* mm_malloc(size_t size) {
+  int k = order_of(size);
+  if (k > MAX_ORDER)
+    return NULL;
+
+  long off = take(k);
+  if (off < 0)
+    return NULL;
+
+  block_order[off >> MIN_ORDER] = k;
+  return base + off;
+}
+
+// mm_free - Free a block and merge it with its free buddies
+void mm_free(void* ptr) {
+  size_t off = (char*)ptr - base;
+  int k = block_order[off >> MIN_ORDER];
+  if (k == 0) {
+    printf("double free or corruption\n");
+    exit(8);
+  }
+  block_order[off >> MIN_ORDER] = 0;
+  release(k, off);
+}
+
+// mm_realloc - Resize the block in place if possible (see the header of this
+// file), otherwise malloc + memcpy + free
+void* mm_realloc(void* ptr, size_t size) {
+  if (ptr == NULL)
+    return mm_malloc(size);
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+
+  size_t off = (char*)ptr - base;
+  int k = block_order[off >> MIN_ORDER];
+  int need = order_of(size);
+  if (need > MAX_ORDER)
+    return NULL;
+
+  if (need <= k) {
+    while (k > need) {
+      --k;
+      release(k, off + BLOCK_SIZE(k));
+    }
+    block_order[off >> MIN_ORDER] = k;
+    return ptr;
+  }
+
+  int j = k;
+  while (j < need && (off & BLOCK_SIZE(j)) == 0) {
+    size_t buddy = off + BLOCK_SIZE(j);
+    if (buddy < top && !(buddy + BLOCK_SIZE(j) <= top && test_bit(j, buddy)))
+      break;
+    ++j;
+  }
+  if (j == need) {
+    size_t end = top;
+    if (off + BLOCK_SIZE(need) > top &&
+        extend(top, off + BLOCK_SIZE(need)) < 0)
+      return NULL;
+    for (j = k; j < need && off + BLOCK_SIZE(j) < end; ++j)
+      remove_free(j, off + BLOCK_SIZE(j));
+    block_order[off >> MIN_ORDER] = need;
+    return ptr;
+  }
+
+  void* newptr = mm_malloc(size);
+  if (newptr == NULL)
+    return NULL;
+  memcpy(newptr, ptr, BLOCK_SIZE(k));
+  mm_free(ptr);
+  return newptr;
+}
+
+// mm_memalign - Blocks are aligned to their size relative to the heap base,
+// so a block of order at least log2(align) is aligned if the base is. Returns
+// NULL for alignments the base doesn't have.
+void* mm_memalign(size_t align, size_t size) {
+  if ((uintptr_t)base % align != 0)
+    return NULL;
+  return mm_malloc(size < align ? align : size);
+}
+
+// mm_usable_size - Returns the size of the block of ptr
+size_t mm_usable_size(void* ptr) {
+  return BLOCK_SIZE(block_order[((char*)ptr - base) >> MIN_ORDER]);
+}
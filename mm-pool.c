@@ -0,0 +1,234 @@
+// mm-pool.c
+
+// Pools of fixed-size objects. A pool carves its objects from chunks that it
+// obtains with mm_malloc, so objects don't pay the block header/footer nor
+// the size class lookup of the main allocator. Free objects are linked in an
+// intrusive LIFO list through their first word, which makes allocation and
+// free a single pointer swap.
+
+// Objects are packed by cache line: the object area of each chunk is aligned
+// to a cache line, and objects smaller than a line are placed so that none of
+// them straddles two lines (the tail of each line stays unused if the object
+// size doesn't divide it). A new chunk is pushed to the free list in address
+// order, so consecutive allocations fill one line after the other.
+
+// Freeing an object doesn't look up its chunk. Chunks whose objects are all
+// free are given back to mm_free by mm_pool_trim, which sorts the chunks by
+// address and assigns every free object to its chunk with a binary search.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "mm-align.h"
+#include "mm-pool.h"
+
+#define CACHE_LINE 64
+
+// bytes of objects per chunk, a chunk holds at least one object anyway
+#define POOL_CHUNK_SIZE 4096
+
+// rounds size up to a multiple of align (a power of two)
+#define ROUND_UP(size, align) (((size) + ((align)-1)) & ~((align)-1))
+
+// chunk header, stored at the beginning of the block returned by mm_malloc
+typedef struct pool_chunk {
+  struct pool_chunk* next;
+  char* objects;            // first object, aligned to area_align
+  size_t nb_free;           // number of free objects, valid in mm_pool_trim
+} pool_chunk_t;
+
+struct mm_pool {
+  void* free_list;          // free objects, linked through their first word
+  pool_chunk_t* chunks;
+  size_t objsize;
+  size_t stride;            // distance between objects of one line
+  size_t per_line;          // objects per line
+  size_t line_bytes;        // cache line, or stride for larger objects
+  size_t nb_objects;        // objects per chunk
+  size_t area_align;        // alignment of the object area of a chunk
+  size_t chunk_bytes;       // size of the mm_malloc block of a chunk
+  size_t nb_chunks;
+  size_t nb_live;
+};
+
+// returns the address of the j-th object of chunk c
+static char* object_at(const mm_pool_t* pool, const pool_chunk_t* c, size_t j)
+{
+  return c->objects + (j / pool->per_line) * pool->line_bytes +
+         (j % pool->per_line) * pool->stride;
+}
+
+// returns the number of bytes of the object area of a chunk
+static size_t area_bytes(const mm_pool_t* pool)
+{
+  return pool->nb_objects / pool->per_line * pool->line_bytes;
+}
+
+mm_pool_t* mm_pool_create(size_t objsize, size_t align)
+{
+  if (align < ALIGNMENT)
+    align = ALIGNMENT;
+  if ((align & (align - 1)) != 0)
+    return NULL;
+
+  mm_pool_t* pool = (mm_pool_t*)mm_malloc(sizeof(mm_pool_t));
+  if (pool == NULL)
+    return NULL;
+
+  pool->free_list = NULL;
+  pool->chunks = NULL;
+  pool->objsize = objsize;
+  pool->stride = ROUND_UP(objsize > sizeof(void*) ? objsize : sizeof(void*),
+                          align);
+  pool->line_bytes = (pool->stride <= CACHE_LINE) ? CACHE_LINE : pool->stride;
+  pool->per_line = pool->line_bytes / pool->stride;
+
+  size_t nb_lines = POOL_CHUNK_SIZE / pool->line_bytes;
+  pool->nb_objects = (nb_lines > 0 ? nb_lines : 1) * pool->per_line;
+  pool->area_align = (align > CACHE_LINE) ? align : CACHE_LINE;
+  pool->chunk_bytes = sizeof(pool_chunk_t) + pool->area_align - 1 +
+                      area_bytes(pool);
+  pool->nb_chunks = 0;
+  pool->nb_live = 0;
+  return pool;
+}
+
+// Allocates a new chunk and pushes its objects to the free list, so that the
+// first object comes out first
+static int add_chunk(mm_pool_t* pool)
+{
+  pool_chunk_t* c = (pool_chunk_t*)mm_malloc(pool->chunk_bytes);
+  if (c == NULL)
+    return 0;
+
+  uintptr_t first = (uintptr_t)(c + 1);
+  c->objects = (char*)ROUND_UP(first, (uintptr_t)pool->area_align);
+  c->next = pool->chunks;
+  pool->chunks = c;
+  pool->nb_chunks++;
+
+  for (size_t j = pool->nb_objects; j-- > 0; ) {
+    void** obj = (void**)object_at(pool, c, j);
+    *obj = pool->free_list;
+    pool->free_list = obj;
+  }
+  return 1;
+}
+
+void* mm_pool_alloc(mm_pool_t* pool)
+{
+  if (pool->free_list == NULL && !add_chunk(pool))
+    return NULL;
+
+  void** obj = (void**)pool->free_list;
+  pool->free_list = *obj;
+  pool->nb_live++;
+  return obj;
+}
+
+void mm_pool_free(mm_pool_t* pool, void* ptr)
+{
+  *(void**)ptr = pool->free_list;
+  pool->free_list = ptr;
+  pool->nb_live--;
+}
+
+// orders chunks by the address of their object area
+static int compare_chunks(const void* a, const void* b)
+{
+  const char* x = (*(pool_chunk_t* const*)a)->objects;
+  const char* y = (*(pool_chunk_t* const*)b)->objects;
+  return (x > y) - (x < y);
+}
+
+// returns the chunk of the sorted array that contains ptr
+static pool_chunk_t* find_chunk(const mm_pool_t* pool, pool_chunk_t** sorted,
+                                const char* ptr)
+{
+  size_t lo = 0;
+  size_t hi = pool->nb_chunks;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (sorted[mid]->objects <= ptr)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return sorted[lo];
+}
+
+// Gives the chunks whose objects are all free back to mm_free. The free list
+// keeps the order of the remaining objects.
+void mm_pool_trim(mm_pool_t* pool)
+{
+  if (pool->nb_chunks == 0)
+    return;
+
+  pool_chunk_t** sorted =
+    (pool_chunk_t**)mm_malloc(pool->nb_chunks * sizeof(pool_chunk_t*));
+  if (sorted == NULL)
+    return;
+
+  size_t n = 0;
+  for (pool_chunk_t* c = pool->chunks; c != NULL; c = c->next) {
+    c->nb_free = 0;
+    sorted[n++] = c;
+  }
+  qsort(sorted, n, sizeof(pool_chunk_t*), compare_chunks);
+
+  for (void* obj = pool->free_list; obj != NULL; obj = *(void**)obj) {
+    find_chunk(pool, sorted, (char*)obj)->nb_free++;
+  }
+
+  // rebuild the free list without the objects of empty chunks
+  void** tail = &pool->free_list;
+  for (void* obj = pool->free_list; obj != NULL; obj = *(void**)obj) {
+    if (find_chunk(pool, sorted, (char*)obj)->nb_free < pool->nb_objects) {
+      *tail = obj;
+      tail = (void**)obj;
+    }
+  }
+  *tail = NULL;
+
+  pool_chunk_t** prev = &pool->chunks;
+  while (*prev != NULL) {
+    pool_chunk_t* c = *prev;
+    if (c->nb_free == pool->nb_objects) {
+      *prev = c->next;
+      mm_free(c);
+      pool->nb_chunks--;
+    } else {
+      prev = &c->next;
+    }
+  }
+
+  mm_free(sorted);
+}
+
+void mm_pool_destroy(mm_pool_t* pool)
+{
+  pool_chunk_t* c = pool->chunks;
+  while (c != NULL) {
+    pool_chunk_t* next = c->next;
+    mm_free(c);
+    c = next;
+  }
+  mm_free(pool);
+}
+
+// Every chunk counts as heap bytes, every object slot as a used or free block
+void mm_pool_stats(mm_pool_t* pool, mm_stats_t* stats)
+{
+  size_t nb_slots = pool->nb_chunks * pool->nb_objects;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->heap_bytes = pool->nb_chunks * pool->chunk_bytes;
+  stats->used_bytes = pool->nb_live * pool->stride;
+  stats->free_bytes = (nb_slots - pool->nb_live) * pool->stride;
+  stats->nb_used = pool->nb_live;
+  stats->nb_free = nb_slots - pool->nb_live;
+  stats->largest_free = (stats->nb_free > 0) ? pool->stride : 0;
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+/*
+ * Fixed-size object pools on top of mm_malloc. Objects carry no header:
+ * free objects are linked through their first word, and objects are
+ * packed so that no object smaller than a cache line straddles two lines.
+ * Include mm.h before this file.
+ */
+typedef struct mm_pool mm_pool_t;
+
+/* align must be a power of two, 0 selects the alignment of mm_malloc */
+extern mm_pool_t *mm_pool_create(size_t objsize, size_t align);
+extern void *mm_pool_alloc(mm_pool_t *pool);
+extern void mm_pool_free(mm_pool_t *pool, void *ptr);
+extern void mm_pool_trim(mm_pool_t *pool);
+extern void mm_pool_destroy(mm_pool_t *pool);
+
+/* fills stats with the same fields as mm_stats for the main allocator */
+extern void mm_pool_stats(mm_pool_t *pool, mm_stats_t *stats);
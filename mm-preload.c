@@ -0,0 +1,186 @@
+// mm-preload.c
+
+// Exports the allocator of mm.c under the names of the C library, so that
+// libmm.so (see the Makefile) replaces malloc in real programs:
+//
+//     LD_PRELOAD=./libmm.so prog args...
+//
+// The heap is the simulated heap of memlib, i.e. a region reserved with
+// mmap(MAP_NORESERVE). Its size is LIBMM_HEAP_SIZE unless MEM_HEAP_SIZE is
+// set; the other memlib variables (MEM_HUGEPAGES, MEM_SBRK_COST) apply too.
+
+// The heap is created on the first call, under pthread_once. memlib allocates
+// its heap record with malloc, so the calls made by the initializing thread
+// itself are served from a small static buffer, whose blocks are never freed.
+// mm.c is not thread-safe: every call takes a single global lock, which
+// fork handlers hold across fork so that the child gets a consistent heap.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define EXPORT __attribute__((visibility("default")))
+
+// default heap size: 64 GB of address space on 64-bit hosts
+#if UINTPTR_MAX > 0xffffffffu
+#define LIBMM_HEAP_SIZE ((size_t)64 << 30)
+#else
+#define LIBMM_HEAP_SIZE ((size_t)1 << 30)
+#endif
+
+// bytes served to the initializing thread
+#define BOOT_SIZE 4096
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int ready;
+
+static __thread int initializing;
+static char boot_buf[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+
+static void lock_heap(void) {
+  pthread_mutex_lock(&lock);
+}
+
+static void unlock_heap(void) {
+  pthread_mutex_unlock(&lock);
+}
+
+static void init_heap(void) {
+  initializing = 1;
+  if (getenv("MEM_HEAP_SIZE") == NULL)
+    mem_set_max_heap(LIBMM_HEAP_SIZE);
+  mem_init();
+  mm_init();
+  pthread_atfork(lock_heap, unlock_heap, unlock_heap);
+  initializing = 0;
+  ready = 1;
+}
+
+// Serves a request of the initializing thread from the static buffer
+static void* boot_malloc(size_t size) {
+  size_t len = (size + 15) & ~(size_t)15;
+  if (len > BOOT_SIZE - boot_used)
+    return NULL;
+  void* p = boot_buf + boot_used;
+  boot_used += len;
+  return p;
+}
+
+static int is_boot(void* ptr) {
+  return (char*)ptr >= boot_buf && (char*)ptr < boot_buf + BOOT_SIZE;
+}
+
+// Returns 0 if the heap cannot serve the calling thread yet
+static int start(void) {
+  if (initializing)
+    return 0;
+  pthread_once(&init_once, init_heap);
+  return 1;
+}
+
+// Is ptr a block of mm.c? Blocks of the static buffer and pointers that come
+// from elsewhere (e.g. the dynamic loader) are ignored by free. Called with
+// the lock held, since the heap may grow.
+static int in_heap(void* ptr) {
+  return ptr >= mem_heap_lo() && ptr <= mem_heap_hi();
+}
+
+EXPORT void* malloc(size_t size) {
+  if (!start())
+    return boot_malloc(size);
+  lock_heap();
+  void* p = mm_malloc(size);
+  unlock_heap();
+  if (p == NULL)
+    errno = ENOMEM;
+  return p;
+}
+
+EXPORT void free(void* ptr) {
+  if (ptr == NULL || !ready)
+    return;
+  lock_heap();
+  if (in_heap(ptr))
+    mm_free(ptr);
+  unlock_heap();
+}
+
+EXPORT void* calloc(size_t nmemb, size_t size) {
+  if (size != 0 && nmemb > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  void* p = malloc(nmemb * size);
+  if (p != NULL && !is_boot(p))
+    memset(p, 0, nmemb * size);
+  return p;
+}
+
+EXPORT void* realloc(void* ptr, size_t size) {
+  // a block of the static buffer is copied to the heap; its size is not
+  // known, but the buffer ends after it
+  if (is_boot(ptr)) {
+    void* p = malloc(size);
+    size_t left = boot_buf + BOOT_SIZE - (char*)ptr;
+    if (p != NULL)
+      memcpy(p, ptr, size < left ? size : left);
+    return p;
+  }
+  if (!start())
+    return NULL;
+  void* p = NULL;
+  lock_heap();
+  if (ptr == NULL || in_heap(ptr))
+    p = mm_realloc(ptr, size);
+  unlock_heap();
+  if (p == NULL && size > 0)
+    errno = ENOMEM;
+  return p;
+}
+
+EXPORT int posix_memalign(void** memptr, size_t align, size_t size) {
+  if (align % sizeof(void*) != 0 || (align & (align - 1)) != 0)
+    return EINVAL;
+  if (!start())
+    return ENOMEM;
+  lock_heap();
+  void* p = mm_memalign(align, size);
+  unlock_heap();
+  if (p == NULL)
+    return ENOMEM;
+  *memptr = p;
+  return 0;
+}
+
+EXPORT void* aligned_alloc(size_t align, size_t size) {
+  void* p;
+  int err = posix_memalign(&p, align < sizeof(void*) ? sizeof(void*) : align,
+                           size);
+  if (err != 0) {
+    errno = err;
+    return NULL;
+  }
+  return p;
+}
+
+EXPORT void* memalign(size_t align, size_t size) {
+  return aligned_alloc(align, size);
+}
+
+EXPORT size_t malloc_usable_size(void* ptr) {
+  size_t n = 0;
+  if (ptr == NULL || !ready)
+    return 0;
+  lock_heap();
+  if (in_heap(ptr))
+    n = mm_usable_size(ptr);
+  unlock_heap();
+  return n;
+}
@@ -2,8 +2,8 @@
 
 // Heap implemented as anexplicit segregated list. Number of size categories to
 // consider is defined at runtime and can be arbitrary, except that the
-// pointers to the first elements of free lists and the size category info
-// should fit to one sbrk page.
+// pointers to the first elements of free lists, the size category info and
+// the headers of the packed indices should fit to one sbrk page.
 
 // Search policy used is "best fit", i.e. the complexity is linear in number of
 // free lists in given size category.
@@ -12,6 +12,27 @@
 // values per 8-byte word and 2 ptr values per 8-byte word. This improves
 // fragmentation on 2%.
 
+// Every size category also keeps a packed side index of its free blocks: the
+// block sizes and their offsets from the heap start live in two dense arrays,
+// so that the best fit search scans contiguous memory (with SSE2/AVX2 compares
+// when the compiler enables them) instead of chasing the links stored in free
+// payloads, which costs a cache miss per block. Every indexed free block with
+// room after its links keeps its position in the index there, so that removing
+// it is O(1). Blocks of the minimal length are looked up by their offset.
+// The arrays of an index share one occupied block of the heap, which is
+// replaced by a block twice as large whenever the index gets full.
+
+// When compiled with -DMM_BIBOP=1, small requests (up to BIBOP_MAX_SIZE bytes)
+// are served from "big bag of pages": every such page is an ordinary occupied
+// block of the heap whose payload is one aligned system page, holding objects
+// of a single size class. A page table indexed by page number gives the class
+// of every heap page, so freeing a small object is a bitmap clear that never
+// reads boundary tags. The page table is an occupied block of the heap too,
+// replaced by a block twice as large when a page lies beyond its end.
+
+// Function memalign places the payload at the first aligned address of a free
+// block large enough for every placement, and frees the part in front of it.
+
 // Function realloc is implemented in a way that it doesn't relocate the block
 // if the old block space is already sufficient to use it. It checks the next
 // block after old block, and if it is free, occupies it. If newsize is not
@@ -22,8 +43,14 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "mm.h"
+#include "mm-align.h"
 #include "memlib.h"
 
 team_t team = {
@@ -39,11 +66,6 @@ team_t team = {
     ""
 };
 
-// single word (4) or double word (8) alignment
-#define ALIGNMENT 8
-// rounds up to the nearest multiple of ALIGNMENT
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-
 // we don't align these values in order to store them in efficient way
 #define SIZE_T_SIZE  (sizeof(size_t))
 #define PTR_T_SIZE   (sizeof(void*))
@@ -58,6 +80,27 @@ team_t team = {
 // returns the address that lies in len bytes before or after ptr
 #define OFFSET(ptr, len) (void*)((char*)(ptr) + (len))
 
+// A free block holds its size regions and the links of its free list, so
+// payloads are at least MIN_PAYLOAD bytes, and a part of a block can be split
+// off as a free block if it has MIN_BLOCK bytes
+#define MIN_PAYLOAD (2*PTR_T_SIZE)
+#define MIN_BLOCK   (2*SIZE_T_SIZE + MIN_PAYLOAD)
+// Larger requests fail: the length of their block (even with the room for an
+// alignment up to this size) must neither wrap around nor overflow the
+// intptr_t argument of mem_sbrk
+#define MAX_PAYLOAD ((size_t)INTPTR_MAX / 4)
+
+// position of the free block p in the packed index of its category, valid
+// unless the index overflowed. Only blocks of at least SLOT_BLOCK bytes have
+// room for it.
+#define SLOT(p) (*(uint32_t*)OFFSET(p, SIZE_T_SIZE + 2*PTR_T_SIZE))
+#define SLOT_BLOCK (MIN_BLOCK + sizeof(uint32_t))
+
+// BiBOP mode for small objects is disabled by default
+#ifndef MM_BIBOP
+#define MM_BIBOP 0
+#endif
+
 // Number of different size categories and the boundary size values.
 // Example: if nb_components = 2, then all blocks
 // have the size <= min_block_sizes[0] or > min_block_sizes[0]
@@ -72,9 +115,203 @@ void**  linked_components;
 // because previously described dynamic arrays are also stored in the heap
 void*   blocks;
 
+// Upper bound for nb_components (one bit per category in packed_pending)
+#define MAX_COMPONENTS 8
+
+// Maximal capacity of the packed index of one size category. If a category
+// gets more free blocks than that, its index "overflows": it is no longer
+// maintained and find_block walks the linked list, until the category becomes
+// empty again. A full index of a smaller capacity overflows as well, until
+// it is moved to a larger block.
+#define PACKED_CAP 4096
+
+// Capacity of the first block of a packed index
+#define PACKED_MIN_CAP 16
+
+// Sizes that don't fit to 31 bits are never indexed (see packed_find)
+#define PACKED_MAX_SIZE ((size_t)1 << 31)
+
+// Packed index of one size category: size[j] is the size of the free block
+// that starts at mem_heap_lo() + offset[j]. Entries are unordered. Both arrays
+// have cap entries and lie in the payload of one block, size first.
+typedef struct {
+  uint32_t* size;
+  uint32_t* offset;
+  uint32_t  count;
+  uint32_t  cap;
+  uint32_t  overflow;
+} packed_list_t;
+
+// array of the packed indices of the size categories, stored in the heap
+// after linked_components
+packed_list_t* packed;
+
+// bit i is set if the packed index of category i got full and should be
+// moved to a larger block. Blocks can't be taken while a free list is being
+// changed, so this is done at the next call of mm_malloc or mm_free.
+static unsigned packed_pending;
+
 // heap consistency checker
 void mm_check(void);
 
+// returns the size category of a block of len bytes
+static size_t size_category(size_t len) {
+  size_t i = 0;
+  while (i < nb_components-1 && len > min_block_sizes[i]) {
+    ++i;
+  }
+  return i;
+}
+
+// returns the position of the entry with the given offset in the packed index,
+// used for the blocks that have no room for their slot
+static long packed_lookup(const packed_list_t* pl, uint32_t offset) {
+  size_t n = pl->count;
+  size_t j = 0;
+#if defined(__AVX2__)
+  __m256i voff = _mm256_set1_epi32((int)offset);
+  for (; j + 8 <= n; j += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(pl->offset + j));
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+                 _mm256_cmpeq_epi32(v, voff)));
+    if (mask != 0)
+      return (long)(j + __builtin_ctz(mask));
+  }
+#elif defined(__SSE2__)
+  __m128i voff = _mm_set1_epi32((int)offset);
+  for (; j + 4 <= n; j += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(pl->offset + j));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, voff)));
+    if (mask != 0)
+      return (long)(j + __builtin_ctz(mask));
+  }
+#endif
+  for (; j < n; ++j) {
+    if (pl->offset[j] == offset)
+      return (long)j;
+  }
+  return -1;
+}
+
+// returns the position of the indexed free block p in the packed index
+static uint32_t packed_slot(const packed_list_t* pl, void* p) {
+  if (*(size_t*)p >= SLOT_BLOCK)
+    return SLOT(p);
+  return (uint32_t)packed_lookup(pl, (char*)p - (char*)mem_heap_lo());
+}
+
+// Best fit over the packed index: returns the position of the smallest block
+// of at least len bytes, or -1 if there is none. The distance size - len is
+// computed in unsigned 32-bit arithmetic, so blocks that are too small wrap
+// around to values >= 2^31 and never beat the initial bound of 2^31. Vector
+// lanes are only compared against the current best distance; the rare lanes
+// that improve it are resolved in scalar code.
+static long packed_find(const packed_list_t* pl, uint32_t len) {
+  size_t n = pl->count;
+  size_t j = 0;
+  uint32_t best = (uint32_t)PACKED_MAX_SIZE;
+  long at = -1;
+#if defined(__AVX2__)
+  const __m256i vsign = _mm256_set1_epi32((int)0x80000000u);
+  __m256i vlen  = _mm256_set1_epi32((int)len);
+  __m256i vbest = _mm256_set1_epi32((int)(best ^ 0x80000000u));
+  for (; j + 8 <= n; j += 8) {
+    __m256i s = _mm256_loadu_si256((const __m256i*)(pl->size + j));
+    __m256i d = _mm256_xor_si256(_mm256_sub_epi32(s, vlen), vsign);
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+                 _mm256_cmpgt_epi32(vbest, d)));
+    while (mask != 0) {
+      size_t k = j + __builtin_ctz(mask);
+      mask &= mask - 1;
+      if (pl->size[k] - len < best) {
+        best = pl->size[k] - len;
+        at = (long)k;
+      }
+    }
+    if (at >= 0) {
+      if (best == 0)
+        return at;
+      vbest = _mm256_set1_epi32((int)(best ^ 0x80000000u));
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i vsign = _mm_set1_epi32((int)0x80000000u);
+  __m128i vlen  = _mm_set1_epi32((int)len);
+  __m128i vbest = _mm_set1_epi32((int)(best ^ 0x80000000u));
+  for (; j + 4 <= n; j += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(pl->size + j));
+    __m128i d = _mm_xor_si128(_mm_sub_epi32(s, vlen), vsign);
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(vbest, d)));
+    while (mask != 0) {
+      size_t k = j + __builtin_ctz(mask);
+      mask &= mask - 1;
+      if (pl->size[k] - len < best) {
+        best = pl->size[k] - len;
+        at = (long)k;
+      }
+    }
+    if (at >= 0) {
+      if (best == 0)
+        return at;
+      vbest = _mm_set1_epi32((int)(best ^ 0x80000000u));
+    }
+  }
+#endif
+  for (; j < n; ++j) {
+    if (pl->size[j] >= len && pl->size[j] - len < best) {
+      best = pl->size[j] - len;
+      at = (long)j;
+      if (best == 0)
+        break;
+    }
+  }
+  return at;
+}
+
+// adds the free block p of len bytes to the packed index of category i.
+// Blocks beyond 4 GB from the heap start overflow the index as well.
+static void packed_add(size_t i, void* p, size_t len) {
+  packed_list_t* pl = &packed[i];
+  size_t offset = (char*)p - (char*)mem_heap_lo();
+  if (pl->overflow)
+    return;
+  if (len >= PACKED_MAX_SIZE || offset > UINT32_MAX) {
+    pl->overflow = 1;
+    return;
+  }
+  if (pl->count == pl->cap) {
+    pl->overflow = 1;
+    if (pl->cap < PACKED_CAP)
+      packed_pending |= 1u << i;
+    return;
+  }
+  pl->size[pl->count] = (uint32_t)len;
+  pl->offset[pl->count] = (uint32_t)offset;
+  if (len >= SLOT_BLOCK)
+    SLOT(p) = (uint32_t)pl->count;
+  pl->count++;
+}
+
+// removes the free block p from the packed index of category i, the last
+// entry takes its place and its block gets the new slot
+static void packed_delete(size_t i, void* p) {
+  packed_list_t* pl = &packed[i];
+  if (!pl->overflow) {
+    uint32_t j = packed_slot(pl, p);
+    pl->count--;
+    if (j != pl->count) {
+      pl->size[j] = pl->size[pl->count];
+      pl->offset[j] = pl->offset[pl->count];
+      if (pl->size[j] >= SLOT_BLOCK)
+        SLOT(OFFSET(mem_heap_lo(), pl->offset[j])) = j;
+    }
+  }
+  if (linked_components[i] == NULL) {
+    pl->count = 0;
+    pl->overflow = 0;
+  }
+}
+
 // deletes element from free block queue, p is a pointer to the very beginning
 // of the block (to size region)
 static void delete_from_queue(void* p) {
@@ -82,11 +319,7 @@ static void delete_from_queue(void* p) {
   void** to_prev = (void**)OFFSET(p, SIZE_T_SIZE);
   void** to_next = (void**)OFFSET((void*)to_prev, PTR_T_SIZE);
   
-  size_t i = 0;
-  size_t len = *(size_t*)p;
-  while (i < nb_components-1 && len > min_block_sizes[i]) {
-    ++i;
-  }
+  size_t i = size_category(*(size_t*)p);
 
   if (*to_prev == NULL) {
     linked_components[i] = *to_next;
@@ -99,6 +332,8 @@ static void delete_from_queue(void* p) {
     void** prev_of_next = (void**)OFFSET(*to_next, -PTR_T_SIZE);
     *prev_of_next = *to_prev;
   }
+
+  packed_delete(i, p);
 }
 
 // adds element to the queue, p is a pointer to the very beginning of the
@@ -111,10 +346,7 @@ static void add_to_queue(void* p) {
   void** to_prev = (void**)OFFSET(p, SIZE_T_SIZE);
   void** to_next = (void**)OFFSET((void*)to_prev, PTR_T_SIZE);
   
-  size_t i = 0;
-  while (i < nb_components-1 && len > min_block_sizes[i]) {
-    ++i;
-  }
+  size_t i = size_category(len);
 
   *to_prev = NULL;
   *to_next = linked_components[i];
@@ -124,23 +356,31 @@ static void add_to_queue(void* p) {
     void** prev_of_next = (void**)OFFSET(*to_next, -PTR_T_SIZE);
     *prev_of_next = (void*)to_prev;
   }
+
+  packed_add(i, p, len);
 }
 
 // Finder for explicit lists
-// len = 2*SIZE_T_SIZE + max(size of payload, 2*PTR_T_SIZE).
+// len = 2*SIZE_T_SIZE + max(size of payload, MIN_PAYLOAD).
 // Search policy is "BEST_FIT". On each step it checks that the found block
 // size is equal to len (it means that it is no more possible to find better
-// free block)
+// free block). Categories with a valid packed index are searched in the
+// index, the others by walking their free list.
 static void* find_block(size_t len)
 {
   void* res = NULL;
-  size_t i = 0;
-  while (i < nb_components - 1 && len > min_block_sizes[i]) {
-    ++i;
-  }
+  size_t i = size_category(len);
 
   while (i < nb_components && res == NULL) {
 
+    if (!packed[i].overflow) {
+      long j = packed_find(&packed[i], (uint32_t)len);
+      if (j >= 0)
+        return OFFSET(mem_heap_lo(), packed[i].offset[j]);
+      i++;
+      continue;
+    }
+
     void* p = linked_components[i];
     size_t dist = mem_heapsize();
     while (p != NULL) {
@@ -204,7 +444,7 @@ static void free_block(void** p) {
 // i.e. size region). Called only by malloc
 static void occupy_block(void* p, size_t len) {
      
-  size_t pload_threshold = 2*(SIZE_T_SIZE + PTR_T_SIZE);
+  size_t pload_threshold = MIN_BLOCK;
   
   size_t* bbeg = (size_t*)p;
   size_t old_size = *bbeg;
@@ -228,7 +468,7 @@ static void occupy_block(void* p, size_t len) {
 }
 
 // Adjusts heap size if needed. If the last block in the heap is free, adjusts
-// only the missing part of size.
+// only the missing part of size. Returns NULL if memlib is out of memory.
 static void* adjust_heap(size_t size)
 {
   size_t adjust_size = size;
@@ -240,10 +480,8 @@ static void* adjust_heap(size_t size)
   }
 
   void* adjust = mem_sbrk(adjust_size);
-  if (adjust == NULL) {
-    printf("cannot adjust heap no more\n");
-    printf("\theap size = %d", mem_heapsize());
-    exit(8);
+  if (adjust == (void*)-1) {
+    return NULL;
   }
   void* adjust_end = OFFSET(adjust, adjust_size - SIZE_T_SIZE);
 
@@ -255,6 +493,366 @@ static void* adjust_heap(size_t size)
   return adjust;
 }
 
+// Returns the length of the block (with both size regions) that stores a
+// payload of size bytes
+static size_t block_length(size_t size)
+{
+  size_t len = (size > MIN_PAYLOAD) ? size : MIN_PAYLOAD;
+  return ALIGN(len) + 2*SIZE_T_SIZE;
+}
+
+// Returns the first address multiple of align (a power of two) that can be
+// the payload of a block beginning at bbeg. The part of the block in front of
+// the payload must be either empty or large enough to be a free block.
+static char* aligned_payload(void* bbeg, size_t align)
+{
+  size_t pload_threshold = MIN_BLOCK;
+  char* payload = (char*)OFFSET(bbeg, SIZE_T_SIZE);
+  char* aligned = (char*)(((uintptr_t)payload + align - 1) &
+                          ~(uintptr_t)(align - 1));
+  while (aligned != payload && (size_t)(aligned - payload) < pload_threshold)
+    aligned += align;
+  return aligned;
+}
+
+// Occupies a block whose payload begins at an address multiple of align (a
+// power of two, at least ALIGNMENT) and holds size bytes. If no free block is
+// large enough for every possible placement, the heap is extended only by the
+// amount the placement at the end of the heap requires. The part in front of
+// the payload is given back to the free lists.
+static void* occupy_aligned(size_t size, size_t align)
+{
+  size_t pload_threshold = MIN_BLOCK;
+  size_t newsize = block_length(size);
+
+  void* p = find_block(newsize + align + pload_threshold);
+  if (p != NULL) {
+    delete_from_queue(p);
+  } else {
+    // the new block begins either at the last free block or at the heap end
+    void* start = OFFSET(mem_heap_hi(), 1);
+    size_t last_size = *(size_t*)OFFSET(mem_heap_hi(), -SIZE_T_SIZE + 1);
+    if ((last_size & 1) == FREE) {
+      start = OFFSET(start, -last_size);
+    }
+    char* end = aligned_payload(start, align) - SIZE_T_SIZE + newsize;
+    size_t need = end - (char*)start;
+    if ((last_size & 1) == FREE && last_size >= need) {
+      p = start;
+      delete_from_queue(p);
+    } else {
+      p = adjust_heap(need);
+      if (p == NULL)
+        return NULL;
+    }
+  }
+
+  size_t total = *(size_t*)p;
+  size_t prefix = aligned_payload(p, align) - (char*)OFFSET(p, SIZE_T_SIZE);
+  if (prefix > 0) {
+    *(size_t*)p = prefix;
+    *(size_t*)OFFSET(p, prefix - SIZE_T_SIZE) = prefix;
+    add_to_queue(p);
+    p = OFFSET(p, prefix);
+    *(size_t*)p = total - prefix;
+  }
+
+  occupy_block(p, newsize);
+  return OFFSET(p, SIZE_T_SIZE);
+}
+
+// Occupies a block for a payload of size bytes, the heap is extended if no
+// free block is large enough. Returns NULL if memlib is out of memory.
+static void* occupy(size_t size)
+{
+  size_t newsize = block_length(size);
+  void* p = find_block(newsize);
+
+  if (p == NULL) {
+    p = adjust_heap(newsize);
+    if (p == NULL)
+      return NULL;
+  } else {
+    delete_from_queue(p);
+  }
+
+  occupy_block(p, newsize);
+  return OFFSET(p, SIZE_T_SIZE);
+}
+
+// Moves the packed index of category i to a block of twice its capacity (of
+// PACKED_MIN_CAP entries for the first block), frees the old block and
+// refills the index from the free list. The index stays overflowed if the new
+// block can't be taken or if the list is still too long for it.
+static void packed_grow(size_t i)
+{
+  packed_list_t* pl = &packed[i];
+  size_t cap = (pl->cap == 0) ? PACKED_MIN_CAP : 2*pl->cap;
+
+  packed_pending &= ~(1u << i);
+  uint32_t* arrays = (uint32_t*)occupy(2*cap*sizeof(uint32_t));
+  if (arrays == NULL)
+    return;
+
+  uint32_t* old = pl->size;
+  pl->size = arrays;
+  pl->offset = arrays + cap;
+  pl->cap = cap;
+  pl->overflow = 1;
+  if (old != NULL) {
+    void* bbeg = OFFSET(old, -SIZE_T_SIZE);
+    free_block(&bbeg);
+    add_to_queue(bbeg);
+  }
+
+  // occupy may have marked the old index as full again
+  pl->count = 0;
+  pl->overflow = 0;
+  packed_pending &= ~(1u << i);
+  for (void* curr = linked_components[i]; curr != NULL && !pl->overflow;
+       curr = *(void**)curr) {
+    void* bbeg = OFFSET(curr, -PTR_T_SIZE - SIZE_T_SIZE);
+    packed_add(i, bbeg, *(size_t*)bbeg);
+  }
+}
+
+// Grows the packed indices that got full
+static void packed_flush(void)
+{
+  while (packed_pending != 0)
+    packed_grow(__builtin_ctz(packed_pending));
+}
+
+#if MM_BIBOP
+
+// Object sizes of the page classes; requests up to BIBOP_MAX_SIZE bytes are
+// rounded up to the nearest class. Objects follow each other from the aligned
+// end of the page header, so every size is a multiple of ALIGNMENT.
+static const size_t bibop_sizes[] = {
+#if ALIGNMENT <= 8
+  8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512
+#elif ALIGNMENT == 16
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+#else
+#error "no small object classes for this ALIGNMENT"
+#endif
+};
+#define BIBOP_NB_CLASSES (sizeof(bibop_sizes) / sizeof(bibop_sizes[0]))
+#define BIBOP_MAX_SIZE 512
+
+// Number of heap pages covered by the first block of the page table
+#define BIBOP_MIN_PAGES 64
+
+// Number of 32-bit bitmap words in a page header, enough for a 4 KB page of
+// 8-byte objects. Classes of larger pages get no more objects than that.
+#define BIBOP_MAP_WORDS 16
+
+// Header at the beginning of every small object page. The bitmap has a bit
+// set for every occupied object. Pages that have free objects are linked in
+// the partial list of their class.
+typedef struct bibop_page {
+  struct bibop_page* prev;
+  struct bibop_page* next;
+  uint32_t klass;
+  uint32_t nb_used;
+  uint32_t bitmap[BIBOP_MAP_WORDS];
+} bibop_page_t;
+
+#define BIBOP_HDR_SIZE ALIGN(sizeof(bibop_page_t))
+
+// page_class[i] is 1 + class of the i-th heap page, or 0 if it is not a small
+// object page. The table is the payload of a heap block and has page_cap
+// entries; there is none until the first small object page is taken.
+static unsigned char* page_class;
+static size_t page_cap;
+static size_t page_size;
+
+// class lookup by (size + 7) / 8, partial pages and objects per page
+static unsigned char bibop_class_of[BIBOP_MAX_SIZE / 8 + 1];
+static bibop_page_t* bibop_partial[BIBOP_NB_CLASSES];
+static uint32_t bibop_capacity[BIBOP_NB_CLASSES];
+
+// returns the page table index of the page that contains p
+static size_t page_index(void* p)
+{
+  return (uintptr_t)p / page_size - (uintptr_t)mem_heap_lo() / page_size;
+}
+
+// returns the small object page that contains p, or NULL if p is not in one
+static bibop_page_t* bibop_page_of(void* p)
+{
+  if (p < mem_heap_lo() || p > mem_heap_hi())
+    return NULL;
+  size_t i = page_index(p);
+  if (i >= page_cap || page_class[i] == 0)
+    return NULL;
+  return (bibop_page_t*)((uintptr_t)p & ~(uintptr_t)(page_size - 1));
+}
+
+static void bibop_link(bibop_page_t* page)
+{
+  page->prev = NULL;
+  page->next = bibop_partial[page->klass];
+  if (page->next != NULL)
+    page->next->prev = page;
+  bibop_partial[page->klass] = page;
+}
+
+static void bibop_unlink(bibop_page_t* page)
+{
+  if (page->prev == NULL)
+    bibop_partial[page->klass] = page->next;
+  else
+    page->prev->next = page->next;
+  if (page->next != NULL)
+    page->next->prev = page->prev;
+}
+
+// Resets the small object state, called by mm_init
+static void bibop_init(void)
+{
+  page_size = mem_pagesize();
+  page_class = NULL;
+  page_cap = 0;
+
+  size_t c = 0;
+  for (size_t s = 0; s <= BIBOP_MAX_SIZE / 8; ++s) {
+    while (bibop_sizes[c] < 8*s)
+      ++c;
+    bibop_class_of[s] = c;
+  }
+  for (c = 0; c < BIBOP_NB_CLASSES; ++c) {
+    size_t n = (page_size - BIBOP_HDR_SIZE) / bibop_sizes[c];
+    bibop_capacity[c] = (n < 32*BIBOP_MAP_WORDS) ? n : 32*BIBOP_MAP_WORDS;
+    bibop_partial[c] = NULL;
+  }
+}
+
+// Moves the page table to a block of at least n entries, at least twice as
+// large as the old one, and frees the old block. Returns 0 if memlib is out
+// of memory.
+static int bibop_grow_table(size_t n)
+{
+  size_t cap = (page_cap == 0) ? BIBOP_MIN_PAGES : 2*page_cap;
+  while (cap < n)
+    cap *= 2;
+
+  unsigned char* table = (unsigned char*)occupy(cap);
+  if (table == NULL)
+    return 0;
+  memset(table, 0, cap);
+  if (page_class != NULL) {
+    memcpy(table, page_class, page_cap);
+    void* bbeg = OFFSET(page_class, -SIZE_T_SIZE);
+    free_block(&bbeg);
+    add_to_queue(bbeg);
+  }
+  page_class = table;
+  page_cap = cap;
+  return 1;
+}
+
+// Takes a new page for class c from the heap. Returns NULL if the page table
+// can't cover it, the page block is then freed again.
+static bibop_page_t* bibop_new_page(size_t c)
+{
+  bibop_page_t* page = (bibop_page_t*)occupy_aligned(page_size, page_size);
+  if (page == NULL)
+    return NULL;
+  size_t i = page_index(page);
+  if (i >= page_cap && !bibop_grow_table(i + 1)) {
+    mm_free(page);
+    return NULL;
+  }
+  page_class[i] = c + 1;
+
+  page->klass = c;
+  page->nb_used = 0;
+  memset(page->bitmap, 0, sizeof(page->bitmap));
+  bibop_link(page);
+  return page;
+}
+
+// Allocates an object of class c, or returns NULL if no page is available
+static void* bibop_malloc(size_t c)
+{
+  bibop_page_t* page = bibop_partial[c];
+  if (page == NULL && (page = bibop_new_page(c)) == NULL)
+    return NULL;
+
+  size_t w = 0;
+  while (page->bitmap[w] == (uint32_t)-1)
+    ++w;
+  size_t k = 32*w + __builtin_ctz(~page->bitmap[w]);
+  page->bitmap[w] |= (uint32_t)1 << (k % 32);
+  if (++page->nb_used == bibop_capacity[c])
+    bibop_unlink(page);
+
+  return OFFSET(page, BIBOP_HDR_SIZE + k*bibop_sizes[c]);
+}
+
+// Frees an object of a small object page. The page goes back to the heap when
+// it becomes empty, unless it is the only partial page of its class.
+static void bibop_free(bibop_page_t* page, void* p)
+{
+  size_t c = page->klass;
+  size_t k = ((char*)p - (char*)OFFSET(page, BIBOP_HDR_SIZE)) / bibop_sizes[c];
+  uint32_t bit = (uint32_t)1 << (k % 32);
+  if ((page->bitmap[k / 32] & bit) == 0) {
+    printf("double free or corruption\n");
+    exit(8);
+  }
+  page->bitmap[k / 32] &= ~bit;
+
+  if (page->nb_used-- == bibop_capacity[c])
+    bibop_link(page);
+
+  if (page->nb_used == 0 && (page->prev != NULL || page->next != NULL)) {
+    bibop_unlink(page);
+    page_class[page_index(page)] = 0;
+    void* bbeg = OFFSET(page, -SIZE_T_SIZE);
+    free_block(&bbeg);
+    add_to_queue(bbeg);
+  }
+}
+
+// Checks the counters of the pages in partial lists and the page table
+static int check_bibop_pages(void)
+{
+  for (size_t c = 0; c < BIBOP_NB_CLASSES; ++c) {
+    for (bibop_page_t* page = bibop_partial[c]; page; page = page->next) {
+      size_t used = 0;
+      for (size_t w = 0; w < BIBOP_MAP_WORDS; ++w)
+        used += __builtin_popcount(page->bitmap[w]);
+      if (page->klass != c || page_class[page_index(page)] != c + 1) {
+        printf("page %p is in the wrong partial list\n", (void*)page);
+        return 0;
+      }
+      if (used != page->nb_used || used >= bibop_capacity[c]) {
+        printf("page %p has wrong number of objects\n", (void*)page);
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+#endif
+
+// returns 1 if the payload p holds the arrays of a packed index or the page
+// table of the small object pages
+static int is_meta_block(void* p)
+{
+  for (size_t i = 0; i < nb_components; ++i)
+    if (packed[i].size == p)
+      return 1;
+#if MM_BIBOP
+  if (p == page_class)
+    return 1;
+#endif
+  return 0;
+}
+
 // Prints LIFO queues of all free blocks in forward and backward order
 static void print_linked_components(void) {
   for (size_t i = 0; i < nb_components; ++i) {
@@ -336,9 +934,7 @@ static int check_block_size(size_t i, size_t len) {
       (i != 0 && len < min_block_sizes[i-1])) {
     printf("block is not in the right list\n");
     printf("\treal block size = %d\n", len);
-    size_t pload_threshold = 2*SIZE_T_SIZE;
-    pload_threshold += (SIZE_T_SIZE > 2*PTR_T_SIZE)? SIZE_T_SIZE : 2*PTR_T_SIZE;
-    size_t min = (i == 0) ? pload_threshold : min_block_sizes[i-1];
+    size_t min = (i == 0) ? MIN_BLOCK : min_block_sizes[i-1];
     size_t max = (i == nb_components-1) ? (unsigned int)(-1) : min_block_sizes[i];
     printf("\texpected size range = [%d, %d]\n", min, max);
     return 0;
@@ -402,10 +998,41 @@ static void check_implicit_heap(void)
   }
 }
 
+// Checks that the packed index of category i describes exactly the blocks of
+// its free list (unless the index overflowed)
+static int check_packed_list(size_t i)
+{
+  const packed_list_t* pl = &packed[i];
+  if (pl->overflow)
+    return 1;
+
+  size_t n = 0;
+  for (void* curr = linked_components[i]; curr != NULL; curr = *(void**)curr) {
+    void* bbeg = OFFSET(curr, -PTR_T_SIZE - SIZE_T_SIZE);
+    uint32_t j = packed_slot(pl, bbeg);
+    if (j >= pl->count ||
+        OFFSET(mem_heap_lo(), pl->offset[j]) != bbeg ||
+        pl->size[j] != *(size_t*)bbeg) {
+      printf("free block %p is missing in packed index %lu\n", bbeg,
+             (unsigned long)i);
+      return 0;
+    }
+    n++;
+  }
+  if (n != pl->count) {
+    printf("packed index %lu has %lu entries for %lu free blocks\n",
+           (unsigned long)i, (unsigned long)pl->count, (unsigned long)n);
+    return 0;
+  }
+  return 1;
+}
+
 // Checks explicit free lists
 static int check_free_lists(void)
 { 
   for (size_t i = 0; i < nb_components; ++i) {
+    if (check_packed_list(i) == 0)
+      return 0;
     void* s = linked_components[i];
     void* f = forward_iterations(s, i);
     void* r = backward_iterations(f);
@@ -424,6 +1051,95 @@ void mm_check()
 {
   check_implicit_heap();
   check_free_lists();
+#if MM_BIBOP
+  check_bibop_pages();
+#endif
+}
+
+// mm_stats - walks the implicit heap. The bytes in front of the first block
+// (size categories, free list heads and packed index headers) and the blocks
+// of the packed indices and of the page table count as used. In BiBOP mode the
+// objects of small object pages are accounted one by one. The list lengths
+// are those of the size categories.
+void mm_stats(mm_stats_t* stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  stats->heap_bytes = mem_heapsize();
+  stats->used_bytes = (char*)blocks - (char*)mem_heap_lo();
+
+  for (void* p = blocks; p < mem_heap_hi(); p = OFFSET(p, (*(size_t*)p & -2)))
+  {
+    size_t len = *(size_t*)p & -2;
+    if ((*(size_t*)p & 1) == FREE) {
+      stats->free_bytes += len;
+      stats->nb_free++;
+      if (len > stats->largest_free)
+        stats->largest_free = len;
+      continue;
+    }
+#if MM_BIBOP
+    bibop_page_t* page = bibop_page_of(OFFSET(p, SIZE_T_SIZE));
+    if (page != NULL) {
+      size_t objsize = bibop_sizes[page->klass];
+      size_t nb_free = bibop_capacity[page->klass] - page->nb_used;
+      stats->used_bytes += len - nb_free*objsize;
+      stats->nb_used += page->nb_used;
+      stats->free_bytes += nb_free*objsize;
+      stats->nb_free += nb_free;
+      if (nb_free > 0 && objsize > stats->largest_free)
+        stats->largest_free = objsize;
+      continue;
+    }
+#endif
+    stats->used_bytes += len;
+    if (!is_meta_block(OFFSET(p, SIZE_T_SIZE)))
+      stats->nb_used++;
+  }
+
+  stats->nb_lists = nb_components;
+  for (size_t i = 0; i < nb_components; ++i)
+    for (void* p = linked_components[i]; p != NULL; p = *(void**)p)
+      stats->list_len[i]++;
+}
+
+// mm_heap_walk - walks the implicit heap like mm_stats. The free list heads
+// in front of the first block are metadata, and so are the blocks of the
+// packed indices and of the page table, and the headers of the small object
+// pages, whose objects are reported one by one.
+void mm_heap_walk(mm_walk_fn fn, void* arg)
+{
+  fn(arg, MM_WALK_META, mem_heap_lo(), (char*)blocks - (char*)mem_heap_lo(),
+     NULL, 0);
+
+  for (void* p = blocks; p < mem_heap_hi(); p = OFFSET(p, (*(size_t*)p & -2)))
+  {
+    size_t len = *(size_t*)p & -2;
+    if ((*(size_t*)p & 1) == FREE) {
+      fn(arg, MM_WALK_FREE, p, len, NULL, 0);
+      continue;
+    }
+#if MM_BIBOP
+    bibop_page_t* page = bibop_page_of(OFFSET(p, SIZE_T_SIZE));
+    if (page != NULL) {
+      size_t objsize = bibop_sizes[page->klass];
+      char* obj = (char*)OFFSET(page, BIBOP_HDR_SIZE);
+      size_t n = bibop_capacity[page->klass];
+      fn(arg, MM_WALK_META, p, len - n*objsize, NULL, 0);
+      for (size_t k = 0; k < n; ++k, obj += objsize) {
+        if (page->bitmap[k / 32] & ((uint32_t)1 << (k % 32)))
+          fn(arg, MM_WALK_USED, obj, objsize, obj, objsize);
+        else
+          fn(arg, MM_WALK_FREE, obj, objsize, NULL, 0);
+      }
+      continue;
+    }
+#endif
+    if (is_meta_block(OFFSET(p, SIZE_T_SIZE)))
+      fn(arg, MM_WALK_META, p, len, NULL, 0);
+    else
+      fn(arg, MM_WALK_USED, p, len, OFFSET(p, SIZE_T_SIZE),
+         len - 2*SIZE_T_SIZE);
+  }
 }
 
 // mm_init - initialize the malloc package.
@@ -437,7 +1153,7 @@ int mm_init(void)
 {
   size_t mps = mem_pagesize();
 
-  if (mem_sbrk(mps + SIZE_T_SIZE) == NULL) {
+  if (mem_sbrk(mps + SIZE_T_SIZE) == (void*)-1) {
     printf("sbrk cannot adjust heap during initialization\n");
     exit(8);
   }
@@ -445,8 +1161,10 @@ int mm_init(void)
   void* hi_heap = OFFSET(mem_heap_hi(), -SIZE_T_SIZE + 1);
 
   nb_components = 3;
+  assert(nb_components <= MAX_COMPONENTS);
   size_t offset_block_sz = (nb_components-1) * SIZE_T_SIZE;
   size_t offset_comps = nb_components * PTR_T_SIZE;
+  size_t offset_packed = nb_components * sizeof(packed_list_t);
   
   min_block_sizes = (size_t*)lo_heap;
   linked_components = (void**)OFFSET(lo_heap, offset_block_sz);
@@ -456,14 +1174,25 @@ int mm_init(void)
   }
   linked_components[nb_components-1] = NULL;
 
-  size_t offset = offset_block_sz + offset_comps;
-  offset = ALIGN(offset + SIZE_T_SIZE) - SIZE_T_SIZE;
+  // the packed indices get their first block when their category gets a
+  // free block, see packed_grow
+  size_t offset = ALIGN(offset_block_sz + offset_comps);
+  packed = (packed_list_t*)OFFSET(lo_heap, offset);
+  memset(packed, 0, offset_packed);
+  packed_pending = 0;
+
+  offset = ALIGN(offset + offset_packed + SIZE_T_SIZE) - SIZE_T_SIZE;
 
   blocks = OFFSET(lo_heap, offset);
   *(size_t*)blocks  = mem_heapsize() - offset;
   *(size_t*)hi_heap = mem_heapsize() - offset;
 
   add_to_queue(blocks);
+  packed_flush();
+
+#if MM_BIBOP
+  bibop_init();
+#endif
 
   return 0;
 }
@@ -472,24 +1201,24 @@ int mm_init(void)
 // Always allocates a block whose size is a multiple of the alignment.
 // If heap should be adjusted to allocate new block, doesn't change the
 // explicit free lists at all. Otherwise, deletes one free block from queue,
-// marks it as occupied and returns pointer to its payload region
+// marks it as occupied and returns pointer to its payload region. In BiBOP
+// mode small requests are served from the page of their class instead.
 void* mm_malloc(size_t size)
 {
-  size_t newsize;
-  void* p;
+  if (size > MAX_PAYLOAD)
+    return NULL;
 
-  newsize = (size > 2*PTR_T_SIZE) ? size : 2*PTR_T_SIZE;
-  newsize = ALIGN(newsize) + 2*SIZE_T_SIZE;
-  p = find_block(newsize);
-  
-  if (p == NULL) {
-    p = adjust_heap(newsize);
-  } else {
-    delete_from_queue(p); 
+  packed_flush();
+
+#if MM_BIBOP
+  if (size > 0 && size <= BIBOP_MAX_SIZE) {
+    void* p = bibop_malloc(bibop_class_of[(size + 7) / 8]);
+    if (p != NULL)
+      return p;
   }
- 
-  occupy_block(p, newsize);  
-  return OFFSET(p, SIZE_T_SIZE);
+#endif
+
+  return occupy(size);
 }
 
 // mm_free - Freeing a block is marking it as free, checking coalescing and
@@ -497,6 +1226,16 @@ void* mm_malloc(size_t size)
 // choose the right size category
 void mm_free(void *p)
 {
+  packed_flush();
+
+#if MM_BIBOP
+  bibop_page_t* page = bibop_page_of(p);
+  if (page != NULL) {
+    bibop_free(page, p);
+    return;
+  }
+#endif
+
   void* bbeg = OFFSET(p, -SIZE_T_SIZE);
   if ((*(size_t*)bbeg & 1) == FREE) {
     printf("double free or corruption\n");
@@ -513,12 +1252,29 @@ void mm_free(void *p)
 // memcpy and frees the old memory region
 void* mm_realloc(void *ptr, size_t size)
 {
+  if (size > MAX_PAYLOAD)
+    return NULL;
+
   if ((ptr != NULL) && (size > 0)) {
+
+#if MM_BIBOP
+    bibop_page_t* page = bibop_page_of(ptr);
+    if (page != NULL) {
+      size_t objsize = bibop_sizes[page->klass];
+      if (size <= objsize)
+        return ptr;
+      void* newptr = mm_malloc(size);
+      if (newptr == NULL)
+        return NULL;
+      memcpy(newptr, ptr, objsize);
+      bibop_free(page, ptr);
+      return newptr;
+    }
+#endif
   
     size_t* bbeg = (size_t*)OFFSET(ptr, -SIZE_T_SIZE);
     size_t oldsize = *bbeg & -2;
-    size_t newsize = (size > 2*PTR_T_SIZE) ? size : 2*PTR_T_SIZE;
-    newsize = ALIGN(newsize) + 2*SIZE_T_SIZE;
+    size_t newsize = block_length(size);
 
     void* resid_beg = OFFSET(bbeg, oldsize);
     size_t adjusted = 0;
@@ -539,6 +1295,8 @@ void* mm_realloc(void *ptr, size_t size)
     } else {
 
       void* newptr = mm_malloc(size);
+      if (newptr == NULL)
+        return NULL;
       if (size < oldsize) {
         oldsize = size;
       }
@@ -553,3 +1311,26 @@ void* mm_realloc(void *ptr, size_t size)
     mm_free(ptr);
   return NULL;
 }
+
+// mm_memalign - Allocate a block whose payload is a multiple of align (a power
+// of two). Alignments up to ALIGNMENT are those of every block.
+void* mm_memalign(size_t align, size_t size)
+{
+  if (align <= ALIGNMENT)
+    return mm_malloc(size);
+  if (size > MAX_PAYLOAD || align > MAX_PAYLOAD)
+    return NULL;
+  return occupy_aligned(size, align);
+}
+
+// mm_usable_size - Returns the number of bytes that the block of ptr can hold,
+// i.e. its length without the size regions (or the size of its object class)
+size_t mm_usable_size(void* ptr)
+{
+#if MM_BIBOP
+  bibop_page_t* page = bibop_page_of(ptr);
+  if (page != NULL)
+    return bibop_sizes[page->klass];
+#endif
+  return (*(size_t*)OFFSET(ptr, -SIZE_T_SIZE) & -2) - 2*SIZE_T_SIZE;
+}
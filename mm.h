@@ -4,6 +4,42 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/*
+ * Heap statistics. The allocator engines fill them by walking the heap;
+ * the object pools of mm-pool.c report their chunks the same way.
+ */
+#define MM_MAX_LISTS 32  /* free lists reported by mm_stats */
+
+typedef struct {
+    size_t heap_bytes;   /* bytes obtained from memlib (or by the pool) */
+    size_t used_bytes;   /* bytes of allocated blocks, overhead included */
+    size_t free_bytes;   /* bytes of free blocks */
+    size_t nb_used;      /* number of allocated blocks */
+    size_t nb_free;      /* number of free blocks */
+    size_t largest_free; /* size of the largest free block */
+    size_t nb_lists;     /* number of free lists of the engine... */
+    size_t list_len[MM_MAX_LISTS];  /* ... and their number of blocks */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *stats);
+
+/*
+ * Heap walk. The engine calls fn for every part of the heap: allocated
+ * blocks (with the payload pointer returned to the caller and the number
+ * of bytes it may use), free blocks, and the bytes of its own metadata.
+ * The parts cover the heap without overlapping.
+ */
+#define MM_WALK_USED 0
+#define MM_WALK_FREE 1
+#define MM_WALK_META 2
+
+typedef void (*mm_walk_fn)(void *arg, int kind, void *start, size_t len,
+			   void *payload, size_t usable);
+
+extern void mm_heap_walk(mm_walk_fn fn, void *arg);
 
 
 /* 
@@ -0,0 +1,353 @@
+/*
+ * mmanalyze.c - Report what a malloc lab trace asks of an allocator
+ *
+ * The trace is streamed once, and the report is printed as JSON, or as
+ * CSV with -c (one "section,key,value,value2" row per figure):
+ *
+ *   summary     counts of requests, peak live bytes and blocks, and the
+ *               theoretical minimum heap: the peak of the live payload
+ *               bytes, and the same with every payload rounded up to
+ *               ALIGNMENT (no allocator can do better than either)
+ *   size        requests per power-of-two size class, and their bytes
+ *   lifetime    blocks per power-of-two lifetime, in ops from the
+ *               allocation to the free; blocks never freed are counted
+ *               in the summary
+ *   live        peak-live curve: the trace is cut into windows, and each
+ *               window reports the largest live bytes and blocks seen
+ *   growth      reallocs per ratio of the new size to the old one
+ *   free_order  frees of the most recent live block (lifo), of the
+ *               oldest one (fifo), or of another one
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "trace.h"
+#include "config.h"
+
+/* Rounds a payload size up to ALIGNMENT */
+#define ALIGN(size) (((long)(size) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
+#define NB_BUCKETS 32         /* power-of-two buckets of sizes and lifetimes */
+#define DEF_POINTS 100        /* default number of points of the live curve */
+
+/* Upper bounds of the realloc growth ratio buckets (the last is open) */
+static const double growth_bounds[] = {0.5, 1, 1.25, 1.5, 2, 4};
+#define NB_GROWTH (sizeof(growth_bounds) / sizeof(growth_bounds[0]) + 1)
+
+/* A live block in the allocation order lists */
+typedef struct {
+    int id;
+    int birth;               /* stale if the id was freed since */
+} order_t;
+
+/* One point of the live curve */
+typedef struct {
+    int op;                  /* last op of the window */
+    long bytes;              /* largest live bytes in the window... */
+    long blocks;             /* ... and live blocks */
+} point_t;
+
+/* Figures of a trace */
+typedef struct {
+    int num_ops, num_ids;
+    long allocs, frees, reallocs;
+    long live, live_aligned, live_blocks;
+    long peak, peak_aligned, peak_blocks;
+    long never_freed;
+    long size_count[NB_BUCKETS], size_bytes[NB_BUCKETS];
+    long life_count[NB_BUCKETS];
+    long growth_count[NB_GROWTH];
+    double growth_sum;
+    long lifo, fifo, other;
+    int num_points;
+    point_t *points;
+} profile_t;
+
+int verbose = 0;  /* read by stream_trace */
+
+static void analyze(trace_t *trace, profile_t *p);
+static void print_json(char *name, profile_t *p);
+static void print_csv(profile_t *p);
+static void usage(void);
+static void app_error(char *msg);
+
+int main(int argc, char **argv)
+{
+    int c, csv = 0, points = DEF_POINTS;
+    trace_t *trace;
+    profile_t p;
+
+    while ((c = getopt(argc, argv, "chp:")) != EOF) {
+	switch (c) {
+	case 'c': /* Print CSV */
+	    csv = 1;
+	    break;
+	case 'p': /* Number of points of the live curve */
+	    points = atoi(optarg);
+	    if (points < 1)
+		app_error("-p needs a positive number of points");
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 1) {
+	usage();
+	exit(1);
+    }
+
+    trace = stream_trace("", argv[optind]);
+    memset(&p, 0, sizeof(p));
+    p.num_points = (trace->num_ops < points) ? trace->num_ops : points;
+    if (p.num_points < 1)
+	p.num_points = 1;
+    if ((p.points = (point_t *)calloc(p.num_points, sizeof(point_t))) == NULL)
+	app_error("malloc failed in main");
+    analyze(trace, &p);
+    free_trace(trace);
+
+    if (csv)
+	print_csv(&p);
+    else
+	print_json(argv[optind], &p);
+    free(p.points);
+    return 0;
+}
+
+/*
+ * log2_bucket - returns the power-of-two bucket of x >= 0
+ */
+static int log2_bucket(long x)
+{
+    int k = 0;
+
+    while (k < NB_BUCKETS - 1 && x >= (2L << k))
+	k++;
+    return k;
+}
+
+/*
+ * analyze - replay the requests of a trace on a model of the live set
+ */
+static void analyze(trace_t *trace, profile_t *p)
+{
+    traceop_t *op;
+    int *sizes, *births;           /* of each live id, birth -1 if dead */
+    order_t *order;                /* live ids in allocation order */
+    int head = 0, top = 0;         /* oldest and past the newest entry */
+    int i, k, id, window;
+    double ratio;
+
+    p->num_ops = trace->num_ops;
+    p->num_ids = trace->num_ids;
+    if ((sizes = (int *)calloc(trace->num_ids + 1, sizeof(int))) == NULL ||
+	(births = (int *)malloc((trace->num_ids + 1) * sizeof(int))) == NULL ||
+	(order = (order_t *)malloc((trace->num_ops + 1) * sizeof(order_t)))
+	== NULL)
+	app_error("malloc failed in analyze");
+    for (i = 0; i <= trace->num_ids; i++)
+	births[i] = -1;
+
+    for (i = 0; i < trace->num_ops; i++) {
+	op = trace_op(trace, i);
+	id = op->index;
+
+	switch (op->type) {
+	case ALLOC:
+	    p->allocs++;
+	    k = log2_bucket(op->size);
+	    p->size_count[k]++;
+	    p->size_bytes[k] += op->size;
+	    sizes[id] = op->size;
+	    births[id] = i;
+	    order[top].id = id;
+	    order[top++].birth = i;
+	    p->live += op->size;
+	    p->live_aligned += ALIGN(op->size);
+	    p->live_blocks++;
+	    break;
+
+	case REALLOC:
+	    p->reallocs++;
+	    k = log2_bucket(op->size);
+	    p->size_count[k]++;
+	    p->size_bytes[k] += op->size;
+	    ratio = (sizes[id] > 0) ? (double)op->size / sizes[id] : 1;
+	    k = 0;
+	    while (k < (int)NB_GROWTH - 1 && ratio > growth_bounds[k])
+		k++;
+	    p->growth_count[k]++;
+	    p->growth_sum += ratio;
+	    p->live += op->size - sizes[id];
+	    p->live_aligned += ALIGN(op->size) - ALIGN(sizes[id]);
+	    sizes[id] = op->size;
+	    break;
+
+	case FREE:
+	    p->frees++;
+	    p->life_count[log2_bucket(i - births[id])]++;
+
+	    /* skip the entries of the blocks freed already */
+	    while (top > head &&
+		   births[order[top - 1].id] != order[top - 1].birth)
+		top--;
+	    while (head < top && births[order[head].id] != order[head].birth)
+		head++;
+	    if (top > head && order[top - 1].id == id)
+		p->lifo++;
+	    else if (top > head && order[head].id == id)
+		p->fifo++;
+	    else
+		p->other++;
+
+	    p->live -= sizes[id];
+	    p->live_aligned -= ALIGN(sizes[id]);
+	    p->live_blocks--;
+	    sizes[id] = 0;
+	    births[id] = -1;
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in analyze");
+	}
+
+	if (p->live > p->peak)
+	    p->peak = p->live;
+	if (p->live_aligned > p->peak_aligned)
+	    p->peak_aligned = p->live_aligned;
+	if (p->live_blocks > p->peak_blocks)
+	    p->peak_blocks = p->live_blocks;
+
+	window = (int)((long)i * p->num_points / trace->num_ops);
+	p->points[window].op = i;
+	if (p->live > p->points[window].bytes)
+	    p->points[window].bytes = p->live;
+	if (p->live_blocks > p->points[window].blocks)
+	    p->points[window].blocks = p->live_blocks;
+    }
+    p->never_freed = p->live_blocks;
+
+    free(sizes);
+    free(births);
+    free(order);
+}
+
+/*
+ * print_json - print the profile as a JSON object
+ */
+static void print_json(char *name, profile_t *p)
+{
+    int k, last;
+
+    printf("{\n  \"trace\": \"%s\",\n", name);
+    printf("  \"summary\": {\"ops\": %d, \"ids\": %d, \"allocs\": %ld, "
+	   "\"frees\": %ld, \"reallocs\": %ld,\n", p->num_ops, p->num_ids,
+	   p->allocs, p->frees, p->reallocs);
+    printf("    \"peak_live_bytes\": %ld, \"peak_live_blocks\": %ld, "
+	   "\"never_freed\": %ld,\n", p->peak, p->peak_blocks, p->never_freed);
+    printf("    \"min_heap\": %ld, \"min_heap_aligned\": %ld, "
+	   "\"alignment\": %d},\n", p->peak, p->peak_aligned, ALIGNMENT);
+
+    for (last = NB_BUCKETS - 1; last > 0 && p->size_count[last] == 0; last--)
+	;
+    printf("  \"size\": [");
+    for (k = 0; k <= last; k++)
+	printf("%s\n    {\"min\": %ld, \"count\": %ld, \"bytes\": %ld}",
+	       k ? "," : "", k ? 1L << k : 0L, p->size_count[k],
+	       p->size_bytes[k]);
+    printf("\n  ],\n");
+
+    for (last = NB_BUCKETS - 1; last > 0 && p->life_count[last] == 0; last--)
+	;
+    printf("  \"lifetime\": [");
+    for (k = 0; k <= last; k++)
+	printf("%s\n    {\"min\": %ld, \"count\": %ld}", k ? "," : "",
+	       k ? 1L << k : 0L, p->life_count[k]);
+    printf("\n  ],\n");
+
+    printf("  \"live\": [");
+    for (k = 0; k < p->num_points; k++)
+	printf("%s\n    {\"op\": %d, \"bytes\": %ld, \"blocks\": %ld}",
+	       k ? "," : "", p->points[k].op, p->points[k].bytes,
+	       p->points[k].blocks);
+    printf("\n  ],\n");
+
+    printf("  \"growth\": {\"mean\": %.4f, \"buckets\": [",
+	   p->reallocs ? p->growth_sum / p->reallocs : 0.0);
+    for (k = 0; k < (int)NB_GROWTH; k++) {
+	if (k < (int)NB_GROWTH - 1)
+	    printf("%s\n    {\"max\": %g, \"count\": %ld}", k ? "," : "",
+		   growth_bounds[k], p->growth_count[k]);
+	else
+	    printf(",\n    {\"max\": null, \"count\": %ld}",
+		   p->growth_count[k]);
+    }
+    printf("\n  ]},\n");
+
+    printf("  \"free_order\": {\"lifo\": %ld, \"fifo\": %ld, "
+	   "\"other\": %ld}\n}\n", p->lifo, p->fifo, p->other);
+}
+
+/*
+ * print_csv - print the profile as "section,key,value,value2" rows
+ */
+static void print_csv(profile_t *p)
+{
+    int k;
+
+    printf("section,key,value,value2\n");
+    printf("summary,ops,%d,\n", p->num_ops);
+    printf("summary,ids,%d,\n", p->num_ids);
+    printf("summary,allocs,%ld,\n", p->allocs);
+    printf("summary,frees,%ld,\n", p->frees);
+    printf("summary,reallocs,%ld,\n", p->reallocs);
+    printf("summary,peak_live_bytes,%ld,\n", p->peak);
+    printf("summary,peak_live_blocks,%ld,\n", p->peak_blocks);
+    printf("summary,never_freed,%ld,\n", p->never_freed);
+    printf("summary,min_heap,%ld,\n", p->peak);
+    printf("summary,min_heap_aligned,%ld,\n", p->peak_aligned);
+    for (k = 0; k < NB_BUCKETS; k++)
+	if (p->size_count[k] > 0)
+	    printf("size,%ld,%ld,%ld\n", k ? 1L << k : 0L, p->size_count[k],
+		   p->size_bytes[k]);
+    for (k = 0; k < NB_BUCKETS; k++)
+	if (p->life_count[k] > 0)
+	    printf("lifetime,%ld,%ld,\n", k ? 1L << k : 0L, p->life_count[k]);
+    for (k = 0; k < p->num_points; k++)
+	printf("live,%d,%ld,%ld\n", p->points[k].op, p->points[k].bytes,
+	       p->points[k].blocks);
+    for (k = 0; k < (int)NB_GROWTH - 1; k++)
+	printf("growth,%g,%ld,\n", growth_bounds[k], p->growth_count[k]);
+    printf("growth,inf,%ld,\n", p->growth_count[NB_GROWTH - 1]);
+    printf("free_order,lifo,%ld,\n", p->lifo);
+    printf("free_order,fifo,%ld,\n", p->fifo);
+    printf("free_order,other,%ld,\n", p->other);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmanalyze [-hc] [-p <n>] <trace>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c      Print CSV instead of JSON.\n");
+    fprintf(stderr, "\t-h      Print this message.\n");
+    fprintf(stderr, "\t-p <n>  Number of points of the live curve "
+	    "(default %d).\n", DEF_POINTS);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
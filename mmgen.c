@@ -0,0 +1,739 @@
+/*
+ * mmgen.c - Generate synthetic malloc lab traces from a workload spec
+ *
+ * The trace is a sequence of allocations; each block gets a size and a
+ * lifetime (in allocations) drawn from distributions, and is freed when
+ * its lifetime is over. A distribution is written as
+ *
+ *     fixed:<v>                       always v
+ *     uniform:<min>:<max>             integers in [min, max]
+ *     lognormal:<median>:<sigma>      exp(ln(median) + sigma * N(0, 1))
+ *     exp:<mean>                      exponential
+ *     zipf:<n>:<s>:<unit>             k * unit, with P(k) ~ 1/k^s, k <= n
+ *
+ * or as a mixture "<w>*<dist>+<w>*<dist>+...", e.g.
+ * "0.9*zipf:16:1.2:16+0.1*lognormal:4096:1".
+ *
+ * The allocations are split into phases (-p); phase i uses the i-th -S
+ * and -L distributions (cycling), and with -F every block still live at
+ * the end of a phase is freed there. With -r, some blocks grow by
+ * realloc a few times during their life. With -m, the oldest live
+ * blocks are freed early whenever the live bytes would exceed the cap.
+ * Blocks still live at the end are freed in the order of their death.
+ *
+ * With -a, the trace is instead one of the adversarial patterns below,
+ * and the other options but -b and -v are ignored.
+ *
+ * The same options and seed always give the same trace: the generator
+ * has its own random number generator and does not use rand().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+#include "trace.h"
+#include "memlib.h"
+
+#define MAX_SPECS   8     /* max number of -S and of -L options */
+#define MAX_PARTS   8     /* max number of parts of a mixture */
+#define MAX_ZIPF_N  (1 << 20)
+#define PIN_SIZE    1     /* blocks that keep free neighbours apart */
+#define ADV_ROUND   64    /* allocations per round of "alternate" */
+
+/* Kinds of distributions */
+enum {DIST_FIXED, DIST_UNIFORM, DIST_LOGNORMAL, DIST_EXP, DIST_ZIPF};
+
+/* Adversarial patterns (-a) */
+enum {ADV_HOLES, ADV_ALTERNATE, ADV_PINGPONG};
+
+/* One part of a distribution */
+typedef struct {
+    int kind;
+    double weight;           /* cumulated weight of the parts up to this one */
+    double a, b, c;          /* parameters, in the order of the spec */
+    double *cdf;             /* cumulated probabilities of the zipf ranks */
+} dist_part_t;
+
+/* A distribution, i.e. a mixture of one or more parts */
+typedef struct {
+    int nparts;
+    dist_part_t parts[MAX_PARTS];
+} dist_t;
+
+/* Pending free or realloc of a block, in a binary min-heap */
+typedef struct {
+    long time;               /* allocation number at which it happens */
+    long seq;                /* creation order, breaks ties */
+    int id;
+    int size;                /* new size of a realloc, 0 for a free */
+} event_t;
+
+/* Generator state */
+static uint64_t rng;                  /* xorshift64* state */
+static event_t *events;               /* min-heap of pending events */
+static long num_events, max_events, event_seq;
+static trace_t *trace;                /* trace being built */
+static int max_ops;
+static int *sizes;                    /* current size of each id, 0 if dead */
+static int *births;                   /* live ids in allocation order */
+static int birth_head, birth_tail;
+static long live, peak;               /* live bytes */
+
+int verbose = 0;
+
+static int parse_dist(const char *spec, dist_t *d);
+static void free_dist(dist_t *d);
+static double sample(dist_t *d);
+static void usage(void);
+static void app_error(char *msg);
+
+/*
+ * random_u64 / random_unit - xorshift64* generator, and a double in (0, 1)
+ */
+static uint64_t random_u64(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 2685821657736338717ull;
+}
+
+static double random_unit(void)
+{
+    return ((random_u64() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/*
+ * add_op - append a request to the trace
+ */
+static void add_op(int type, int id, int size)
+{
+    traceop_t *op;
+
+    if (trace->num_ops == max_ops) {
+	max_ops = max_ops ? 2 * max_ops : 65536;
+	if ((trace->ops = (traceop_t *)
+	     realloc(trace->ops, max_ops * sizeof(traceop_t))) == NULL)
+	    app_error("realloc failed in add_op");
+    }
+    op = &trace->ops[trace->num_ops++];
+    op->type = type;
+    op->index = id;
+    op->size = size;
+}
+
+/*
+ * push_event / pop_event - the event heap
+ */
+static int event_before(event_t *x, event_t *y)
+{
+    return x->time < y->time || (x->time == y->time && x->seq < y->seq);
+}
+
+static void push_event(long time, int id, int size)
+{
+    long i = num_events++;
+    event_t e;
+
+    if (num_events > max_events) {
+	max_events = max_events ? 2 * max_events : 65536;
+	if ((events = (event_t *)
+	     realloc(events, max_events * sizeof(event_t))) == NULL)
+	    app_error("realloc failed in push_event");
+    }
+    e.time = time;
+    e.seq = event_seq++;
+    e.id = id;
+    e.size = size;
+    while (i > 0 && event_before(&e, &events[(i - 1) / 2])) {
+	events[i] = events[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+    events[i] = e;
+}
+
+static event_t pop_event(void)
+{
+    event_t top = events[0], last = events[--num_events];
+    long i = 0, child;
+
+    while ((child = 2 * i + 1) < num_events) {
+	if (child + 1 < num_events && event_before(&events[child + 1],
+						   &events[child]))
+	    child++;
+	if (!event_before(&events[child], &last))
+	    break;
+	events[i] = events[child];
+	i = child;
+    }
+    events[i] = last;
+    return top;
+}
+
+/*
+ * free_block / resize_block - emit a free or a realloc, and account the
+ *    live bytes
+ */
+static void free_block(int id)
+{
+    add_op(FREE, id, 0);
+    live -= sizes[id];
+    sizes[id] = 0;
+}
+
+static void resize_block(int id, int size)
+{
+    add_op(REALLOC, id, size);
+    live += size - sizes[id];
+    sizes[id] = size;
+    if (live > peak)
+	peak = live;
+}
+
+/*
+ * alloc_block - emit an allocation, and account the live bytes
+ */
+static void alloc_block(int id, int size)
+{
+    add_op(ALLOC, id, size);
+    sizes[id] = size;
+    live += size;
+    if (live > peak)
+	peak = live;
+}
+
+/*
+ * make_room - free the oldest live blocks (but not keep) until size more
+ *    bytes fit under the cap
+ */
+static void make_room(long cap, long size, int keep)
+{
+    int id;
+
+    while (live + size > cap && birth_head < birth_tail) {
+	id = births[birth_head];
+	if (sizes[id] == 0) {           /* dead already */
+	    birth_head++;
+	    continue;
+	}
+	if (id == keep)
+	    break;
+	free_block(id);
+	birth_head++;
+    }
+}
+
+/*
+ * Adversarial patterns, aimed at the worst cases of mm.c. The cost of
+ * a request is given for its default build, with h the number of free
+ * blocks in the size category of the request (categories end at 3072
+ * and 4096 bytes with 4 KB pages).
+ *
+ * holes:<n>:<size>       n blocks of <size> bytes, each followed by a
+ *     pin, are freed, then n blocks of <size> + 16 bytes are requested.
+ *     No hole fits, so each malloc scans all h = n holes before growing
+ *     the heap: O(n) per malloc, O(n^2) in all. Up to PACKED_CAP (4096)
+ *     holes the scan is over the packed index; beyond, the category
+ *     overflows and find_block chases the free list, a miss per hole.
+ *
+ * alternate:<n>:<size>   n allocations in rounds of ADV_ROUND, those of
+ *     round r of <size> + 16r bytes; at the end of a round every other
+ *     block of it is freed. No two free blocks are ever adjacent, so
+ *     coalescing never merges them, and all are too small for the later
+ *     rounds: h grows to n/2, each malloc is O(h), and the utilization
+ *     tends to 1/2.
+ *
+ * pingpong:<n>:<h>       h free blocks of 64 bytes, then a block of 1024
+ *     bytes followed by a pin is shrunk by 64 bytes and grown back, n
+ *     times. Shrinking splits off a small free remainder, appended to a
+ *     packed index of h entries; growing absorbs it again. Both must be
+ *     O(1) whatever h: a removal that searches the index for the block
+ *     costs O(h) per realloc, up to h = PACKED_CAP.
+ *
+ * Requests of at most BIBOP_MAX_SIZE (512) bytes are served from pages
+ * with -DMM_BIBOP=1, where the pins and small holes above behave
+ * differently.
+ */
+static const struct {
+    char *name;
+    int kind, n, size;       /* defaults of <n> and of the 2nd parameter */
+} patterns[] = {
+    {"holes", ADV_HOLES, 8192, 600},
+    {"alternate", ADV_ALTERNATE, 8192, 600},
+    {"pingpong", ADV_PINGPONG, 100000, 4000}
+};
+#define NB_PATTERNS (int)(sizeof(patterns) / sizeof(patterns[0]))
+
+/*
+ * parse_pattern - parse "<name>[:<n>[:<param>]]" into a pattern and its
+ *    parameters. Returns -1 if spec is not valid.
+ */
+static int parse_pattern(const char *spec, int *n, int *param)
+{
+    const char *s = strchr(spec, ':');
+    size_t len = (s != NULL) ? (size_t)(s - spec) : strlen(spec);
+    char *end;
+    int k;
+
+    for (k = 0; k < NB_PATTERNS; k++)
+	if (strlen(patterns[k].name) == len &&
+	    strncmp(spec, patterns[k].name, len) == 0)
+	    break;
+    if (k == NB_PATTERNS)
+	return -1;
+    *n = patterns[k].n;
+    *param = patterns[k].size;
+    if (s != NULL) {
+	*n = strtol(s + 1, &end, 10);
+	if (*end == ':')
+	    *param = strtol(end + 1, &end, 10);
+	if (*end != '\0')
+	    return -1;
+    }
+    if (*n < 1 || *param < 1 || *param > INT_MAX / 4)
+	return -1;
+    return k;
+}
+
+/*
+ * pattern_ids - number of ids used by a pattern
+ */
+static int pattern_ids(int k, int n, int param)
+{
+    switch (patterns[k].kind) {
+    case ADV_HOLES:
+	return 3 * n;
+    case ADV_ALTERNATE:
+	return n;
+    default:
+	return 2 * param + 2;
+    }
+}
+
+/*
+ * gen_pattern - build the trace of an adversarial pattern, then free
+ *    the blocks still live
+ */
+static void gen_pattern(int k, int n, int param)
+{
+    int i, j, num_ids = pattern_ids(k, n, param);
+
+    switch (patterns[k].kind) {
+    case ADV_HOLES:
+	for (i = 0; i < n; i++) {
+	    alloc_block(2 * i, param);
+	    alloc_block(2 * i + 1, PIN_SIZE);
+	}
+	for (i = 0; i < n; i++)
+	    free_block(2 * i);
+	for (i = 0; i < n; i++)
+	    alloc_block(2 * n + i, param + 16);
+	break;
+    case ADV_ALTERNATE:
+	for (i = 0; i < n; i++) {
+	    alloc_block(i, param + 16 * (i / ADV_ROUND));
+	    if (i % ADV_ROUND == ADV_ROUND - 1)
+		for (j = i - ADV_ROUND + 1; j <= i; j += 2)
+		    free_block(j);
+	}
+	break;
+    case ADV_PINGPONG:
+	for (i = 0; i < param; i++) {
+	    alloc_block(2 * i, 64);
+	    alloc_block(2 * i + 1, PIN_SIZE);
+	}
+	for (i = 0; i < param; i++)
+	    free_block(2 * i);
+	alloc_block(2 * param, 1024);
+	alloc_block(2 * param + 1, PIN_SIZE);
+	for (i = 0; i < n; i++) {
+	    resize_block(2 * param, 1024 - 64);
+	    resize_block(2 * param, 1024);
+	}
+	break;
+    }
+    for (i = 0; i < num_ids; i++)
+	if (sizes[i] != 0)
+	    free_block(i);
+}
+
+/*
+ * clamp - converts a sample to a request size or a lifetime
+ */
+static int clamp(double x, int lo, int hi)
+{
+    if (!(x >= lo))          /* also catches NaN */
+	return lo;
+    if (x >= hi)
+	return hi;
+    return (int)(x + 0.5);
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, id;
+    int num_ids = 10000, num_phases = 1, free_phases = 0, binary = 0;
+    int nsize = 0, nlife = 0, phase, chain, size;
+    long t, life, cap = LONG_MAX;
+    double realloc_prob = 0, growth = 2;
+    int max_chain = 0;
+    int pattern = -1, pattern_n = 0, pattern_param = 0;
+    dist_t size_dist[MAX_SPECS], life_dist[MAX_SPECS];
+    size_t bytes;
+    char *end;
+    event_t e;
+
+    rng = 1;
+    while ((c = getopt(argc, argv, "hvbFn:s:S:L:r:p:m:a:")) != EOF) {
+	switch (c) {
+	case 'n': /* Number of allocations */
+	    num_ids = atoi(optarg);
+	    if (num_ids < 1)
+		app_error("-n needs a positive number of allocations");
+	    break;
+	case 's': /* Seed */
+	    rng = strtoull(optarg, NULL, 0) * 0x9e3779b97f4a7c15ull + 1;
+	    break;
+	case 'S': /* Size distribution of the next phase */
+	case 'L': /* Lifetime distribution of the next phase */
+	    if ((c == 'S' ? nsize : nlife) == MAX_SPECS)
+		app_error("Too many -S or -L options");
+	    if (parse_dist(optarg, (c == 'S') ? &size_dist[nsize++]
+			   : &life_dist[nlife++]) < 0) {
+		fprintf(stderr, "Bad distribution \"%s\"\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'r': /* Realloc chains: <prob>:<max length>:<growth> */
+	    realloc_prob = strtod(optarg, &end);
+	    if (*end == ':')
+		max_chain = strtol(end + 1, &end, 10);
+	    if (*end == ':')
+		growth = strtod(end + 1, &end);
+	    if (*end != '\0' || realloc_prob < 0 || realloc_prob > 1 ||
+		max_chain < 1 || growth <= 0)
+		app_error("-r needs <prob>:<max length>[:<growth>]");
+	    break;
+	case 'p': /* Number of phases */
+	    num_phases = atoi(optarg);
+	    if (num_phases < 1)
+		app_error("-p needs a positive number of phases");
+	    break;
+	case 'F': /* Free the live blocks at the end of each phase */
+	    free_phases = 1;
+	    break;
+	case 'm': /* Cap of the live bytes */
+	    if ((bytes = mem_parse_size(optarg)) == 0 || bytes > INT_MAX)
+		app_error("-m needs a size, e.g. 64M");
+	    cap = (long)bytes;
+	    break;
+	case 'a': /* Adversarial pattern */
+	    pattern = parse_pattern(optarg, &pattern_n, &pattern_param);
+	    if (pattern < 0) {
+		fprintf(stderr, "Bad pattern \"%s\"\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'b': /* Write a binary trace */
+	    binary = 1;
+	    break;
+	case 'v': /* Print a summary */
+	    verbose = 1;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 1) {
+	usage();
+	exit(1);
+    }
+    if (nsize == 0)
+	parse_dist("uniform:1:1024", &size_dist[nsize++]);
+    if (nlife == 0)
+	parse_dist("exp:100", &life_dist[nlife++]);
+    if (pattern >= 0)
+	num_ids = pattern_ids(pattern, pattern_n, pattern_param);
+
+    if ((trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL ||
+	(sizes = (int *)calloc(num_ids, sizeof(int))) == NULL ||
+	(births = (int *)malloc(num_ids * sizeof(int))) == NULL)
+	app_error("malloc failed in main");
+
+    if (pattern >= 0)
+	gen_pattern(pattern, pattern_n, pattern_param);
+    else {
+	/* Allocation t happens at time t, after the events due then */
+	for (t = 0; t < num_ids; t++) {
+	    phase = (int)(t * num_phases / num_ids);
+	    if (free_phases && t > 0 &&
+		phase != (t - 1) * num_phases / num_ids)
+		while (birth_head < birth_tail) {
+		    id = births[birth_head++];
+		    if (sizes[id] != 0)
+			free_block(id);
+		}
+	    while (num_events > 0 && events[0].time <= t) {
+		e = pop_event();
+		if (sizes[e.id] == 0)      /* freed early */
+		    continue;
+		if (e.size == 0)
+		    free_block(e.id);
+		else {
+		    if (e.size > sizes[e.id])
+			make_room(cap, e.size - sizes[e.id], e.id);
+		    resize_block(e.id, e.size);
+		}
+	    }
+
+	    id = (int)t;
+	    size = clamp(sample(&size_dist[phase % nsize]), 1,
+			 (int)(cap < INT_MAX ? cap : INT_MAX));
+	    life = clamp(sample(&life_dist[phase % nlife]), 1, INT_MAX);
+	    make_room(cap, size, -1);
+	    alloc_block(id, size);
+	    births[birth_tail++] = id;
+
+	    /* Reallocs spread evenly over the life, queued before the free */
+	    if (realloc_prob > 0 && random_unit() < realloc_prob) {
+		chain = 1 + (int)(random_u64() % max_chain);
+		for (i = 1; i <= chain; i++) {
+		    size = clamp(size * growth, 1,
+				 (int)(cap < INT_MAX ? cap : INT_MAX));
+		    push_event(t + life * i / (chain + 1), id, size);
+		}
+	    }
+	    push_event(t + life, id, 0);
+	}
+
+	/* Free the survivors in the order of their death */
+	while (num_events > 0) {
+	    e = pop_event();
+	    if (sizes[e.id] != 0 && e.size == 0)
+		free_block(e.id);
+	}
+    }
+
+    trace->sugg_heapsize = (int)peak;
+    trace->num_ids = num_ids;
+    trace->weight = 1;
+    trace->ops_base = 0;
+    trace->ops_end = trace->num_ops;
+    if (verbose)
+	printf("%s: %d ids, %d ops, peak of %ld live bytes\n", argv[optind],
+	       trace->num_ids, trace->num_ops, peak);
+    if (write_trace(trace, argv[optind], binary) < 0) {
+	printf("Could not write %s: %s\n", argv[optind], strerror(errno));
+	exit(1);
+    }
+    free_trace(trace);
+    for (i = 0; i < nsize; i++)
+	free_dist(&size_dist[i]);
+    for (i = 0; i < nlife; i++)
+	free_dist(&life_dist[i]);
+    free(events);
+    free(sizes);
+    free(births);
+    return 0;
+}
+
+/*
+ * parse_part - parse one distribution of a mixture. Returns -1 if spec
+ *    is not valid.
+ */
+static int parse_part(const char *spec, dist_part_t *p)
+{
+    static const struct {
+	char *name;
+	int kind, nargs;
+    } kinds[] = {
+	{"fixed", DIST_FIXED, 1}, {"uniform", DIST_UNIFORM, 2},
+	{"lognormal", DIST_LOGNORMAL, 2}, {"exp", DIST_EXP, 1},
+	{"zipf", DIST_ZIPF, 3}
+    };
+    double args[3];
+    const char *s = strchr(spec, ':');
+    char *end;
+    size_t len, k;
+    int i, nargs = 0;
+
+    if (s == NULL)
+	return -1;
+    len = s - spec;
+    for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++)
+	if (strlen(kinds[k].name) == len && strncmp(spec, kinds[k].name,
+						    len) == 0)
+	    break;
+    if (k == sizeof(kinds) / sizeof(kinds[0]))
+	return -1;
+    while (*s == ':' && nargs < 3) {
+	args[nargs++] = strtod(s + 1, &end);
+	if (end == s + 1)
+	    return -1;
+	s = end;
+    }
+    if ((*s != '\0' && *s != '+') || nargs != kinds[k].nargs)
+	return -1;
+
+    p->kind = kinds[k].kind;
+    p->a = args[0];
+    p->b = (nargs > 1) ? args[1] : 0;
+    p->c = (nargs > 2) ? args[2] : 0;
+    p->cdf = NULL;
+    switch (p->kind) {
+    case DIST_UNIFORM:
+	return (p->a <= p->b) ? 0 : -1;
+    case DIST_LOGNORMAL:
+	return (p->a > 0 && p->b >= 0) ? 0 : -1;
+    case DIST_ZIPF:
+	if (p->a < 1 || p->a > MAX_ZIPF_N || p->b < 0 || p->c <= 0)
+	    return -1;
+	if ((p->cdf = (double *)malloc((int)p->a * sizeof(double))) == NULL)
+	    app_error("malloc failed in parse_part");
+	for (i = 0; i < (int)p->a; i++)
+	    p->cdf[i] = ((i > 0) ? p->cdf[i - 1] : 0) + pow(i + 1, -p->b);
+	return 0;
+    default:
+	return 0;
+    }
+}
+
+/*
+ * parse_dist - parse a distribution spec (see the top of this file).
+ *    Returns -1 if it is not valid.
+ */
+static int parse_dist(const char *spec, dist_t *d)
+{
+    const char *s = spec;
+    char *end;
+    double w, total = 0;
+
+    d->nparts = 0;
+    while (*s != '\0') {
+	if (d->nparts == MAX_PARTS)
+	    return -1;
+	w = 1;
+	if ((s[0] >= '0' && s[0] <= '9') || s[0] == '.') {
+	    w = strtod(s, &end);
+	    if (*end != '*' || w <= 0)
+		return -1;
+	    s = end + 1;
+	}
+	if (parse_part(s, &d->parts[d->nparts]) < 0)
+	    return -1;
+	total += w;
+	d->parts[d->nparts++].weight = total;
+	if ((s = strchr(s, '+')) == NULL)
+	    break;
+	s++;
+    }
+    return (d->nparts > 0) ? 0 : -1;
+}
+
+/*
+ * free_dist - free the tables of a distribution
+ */
+static void free_dist(dist_t *d)
+{
+    int i;
+
+    for (i = 0; i < d->nparts; i++)
+	free(d->parts[i].cdf);
+}
+
+/*
+ * sample - draw a value from a distribution
+ */
+static double sample(dist_t *d)
+{
+    dist_part_t *p = &d->parts[0];
+    double u, v, x;
+    int lo, hi, mid;
+
+    if (d->nparts > 1) {
+	u = random_unit() * d->parts[d->nparts - 1].weight;
+	while (p < &d->parts[d->nparts - 1] && u >= p->weight)
+	    p++;
+    }
+
+    switch (p->kind) {
+    case DIST_FIXED:
+	return p->a;
+    case DIST_UNIFORM:
+	return floor(p->a) + (double)(random_u64() %
+				      (uint64_t)(floor(p->b) - floor(p->a) + 1));
+    case DIST_LOGNORMAL:
+	u = random_unit();
+	v = random_unit();
+	x = sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+	return p->a * exp(p->b * x);
+    case DIST_EXP:
+	return -p->a * log(random_unit());
+    case DIST_ZIPF:
+	u = random_unit() * p->cdf[(int)p->a - 1];
+	lo = 0;
+	hi = (int)p->a - 1;
+	while (lo < hi) {
+	    mid = (lo + hi) / 2;
+	    if (p->cdf[mid] < u)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	return (lo + 1) * p->c;
+    }
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmgen [-hvbF] [-n <n>] [-s <seed>] [-S <dist>] "
+	    "[-L <dist>]\n"
+	    "             [-r <prob>:<len>[:<growth>]] [-p <n>] [-m <size>] "
+	    "<out>\n"
+	    "       mmgen [-hvb] -a <pattern> <out>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a <pat>   Adversarial pattern instead: "
+	    "holes[:<n>[:<size>]],\n\t           alternate[:<n>[:<size>]] "
+	    "or pingpong[:<n>[:<holes>]].\n");
+    fprintf(stderr, "\t-b         Write a binary trace.\n");
+    fprintf(stderr, "\t-F         Free the live blocks at the end of "
+	    "each phase.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-L <dist>  Lifetimes, in allocations (default "
+	    "exp:100).\n");
+    fprintf(stderr, "\t-m <size>  Cap the live bytes, e.g. 64M.\n");
+    fprintf(stderr, "\t-n <n>     Number of allocations (default 10000).\n");
+    fprintf(stderr, "\t-p <n>     Number of phases; each -S and -L "
+	    "option is a phase.\n");
+    fprintf(stderr, "\t-r <spec>  Grow blocks by <growth> (default 2) up "
+	    "to <len> times,\n\t           with probability <prob>.\n");
+    fprintf(stderr, "\t-s <seed>  Seed of the generator (default 0).\n");
+    fprintf(stderr, "\t-S <dist>  Sizes (default uniform:1:1024).\n");
+    fprintf(stderr, "\t-v         Print a summary.\n");
+    fprintf(stderr, "Distributions: fixed:<v> uniform:<min>:<max> "
+	    "lognormal:<median>:<sigma>\n"
+	    "               exp:<mean> zipf:<n>:<s>:<unit>, or mixtures "
+	    "<w>*<dist>+...\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
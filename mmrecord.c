@@ -0,0 +1,341 @@
+/*
+ * mmrecord.c - Record the allocation requests of a real program
+ *
+ * Build with "make mmrecord.so" and run
+ *
+ *     MMRECORD_FILE=prog.raw LD_PRELOAD=./mmrecord.so prog args...
+ *     mmtrace -r prog.raw prog.rep
+ *
+ * The library interposes malloc, calloc, realloc, free and the aligned
+ * allocation functions, and forwards them to the glibc implementations
+ * (__libc_malloc...). Every request gets a sequence number from a global
+ * atomic counter and is appended to a buffer of the calling thread, so
+ * the threads never take a lock; full buffers are written to the output
+ * file with a single write(2) in O_APPEND mode. Raw records hold the
+ * addresses of the blocks; mmtrace -r orders them by sequence number and
+ * turns the addresses into block ids.
+ *
+ * A free gets its number before the block is released, and an
+ * allocation after the block is obtained, so that a block is never seen
+ * reused before it is freed. Only the old block of a realloc may be
+ * reused by another thread before the realloc is numbered; mmtrace then
+ * records the realloc as a new allocation.
+ *
+ * The library itself never calls malloc: buffers are mapped with mmap,
+ * and a thread that allocates from within the recorder (e.g. in
+ * pthread_setspecific) is not recorded.
+ *
+ * A buffer is handed over with an atomic state: a thread takes an idle
+ * one, marks it busy while it appends, and makes it idle again when it
+ * exits, after which its requests (from other destructors) are written
+ * one by one. At exit, mmrecord_fini closes every buffer, waiting for
+ * the appends under way, and flushes it; later requests are dropped.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "trace.h"
+
+/* Number of records in a thread buffer */
+#define RECORD_BUF 4096
+
+/* The glibc allocator */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+/* States of a buffer */
+enum {
+    BUF_IDLE,      /* free for a new thread */
+    BUF_OWNED,     /* taken by a thread */
+    BUF_BUSY,      /* its thread is appending to it or flushing it */
+    BUF_CLOSED     /* flushed by mmrecord_fini, never written again */
+};
+
+/* Records of one thread */
+typedef struct record_buf {
+    struct record_buf *next; /* list of all buffers */
+    int state;               /* BUF_xxx, changed atomically */
+    int count;               /* number of records */
+    rawop_t ops[RECORD_BUF];
+} record_buf_t;
+
+static int out_fd = -1;              /* output file, -1 if not recording */
+static uint64_t next_seq = 0;        /* next sequence number */
+static record_buf_t *buffers = NULL; /* all buffers, pushed with CAS */
+static pthread_key_t buf_key;        /* flushes a buffer at thread exit */
+
+static __thread record_buf_t *my_buf = NULL;
+static __thread int in_recorder = 0;  /* recursion guard */
+static __thread int exiting = 0;      /* buffer released by release_buf */
+
+/*
+ * write_records - write len bytes of records to the output file
+ */
+static void write_records(int fd, char *p, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0 && (n = write(fd, p, len)) != 0) {
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	p += n;
+	len -= n;
+    }
+}
+
+/*
+ * flush_buf - write the records of a buffer to the output file
+ */
+static void flush_buf(record_buf_t *b)
+{
+    write_records(out_fd, (char *)b->ops, b->count * sizeof(rawop_t));
+    b->count = 0;
+}
+
+/*
+ * claim_buf - move a buffer from state from to BUF_BUSY. Returns 0 if
+ *    it is in another state.
+ */
+static int claim_buf(record_buf_t *b, int from)
+{
+    return __atomic_compare_exchange_n(&b->state, &from, BUF_BUSY, 0,
+				       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/*
+ * release_buf - thread exit: flush the buffer and let another thread
+ *    take it. The thread forgets it first, so that the requests of the
+ *    destructors that run after this one never reach it.
+ */
+static void release_buf(void *arg)
+{
+    record_buf_t *b = (record_buf_t *)arg;
+
+    my_buf = NULL;
+    exiting = 1;
+    if (!claim_buf(b, BUF_OWNED))     /* closed by mmrecord_fini */
+	return;
+    flush_buf(b);
+    __atomic_store_n(&b->state, BUF_IDLE, __ATOMIC_RELEASE);
+}
+
+/*
+ * get_buf - returns the buffer of the calling thread: an idle buffer of
+ *    an exited thread, or a new one
+ */
+static record_buf_t *get_buf(void)
+{
+    record_buf_t *b;
+
+    for (b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b; b = b->next) {
+	int idle = BUF_IDLE;
+
+	if (__atomic_load_n(&b->state, __ATOMIC_RELAXED) == BUF_IDLE &&
+	    __atomic_compare_exchange_n(&b->state, &idle, BUF_OWNED, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	    break;
+    }
+
+    if (b == NULL) {
+	b = mmap(NULL, sizeof(record_buf_t), PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (b == MAP_FAILED)
+	    return NULL;
+	b->state = BUF_OWNED;
+	b->count = 0;
+	b->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&buffers, &b->next, b, 1,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	    ;
+    }
+    pthread_setspecific(buf_key, b);
+    return b;
+}
+
+/*
+ * record - append a request to the buffer of the calling thread, or
+ *    write it at once if the thread is exiting. seq is taken by the
+ *    caller (see the top of this file).
+ */
+static void record(uint64_t seq, int type, void *ptr, void *old, size_t size)
+{
+    rawop_t op;
+    record_buf_t *b;
+    int fd;
+
+    op.seq = seq;
+    op.type = type;
+    op.ptr = (uintptr_t)ptr;
+    op.old = (uintptr_t)old;
+    op.size = size;
+    op.reserved = 0;
+
+    if (exiting) {
+	/* A single append of a record is atomic with O_APPEND */
+	if ((fd = __atomic_load_n(&out_fd, __ATOMIC_ACQUIRE)) >= 0)
+	    write_records(fd, (char *)&op, sizeof(op));
+	return;
+    }
+    if (my_buf == NULL && (my_buf = get_buf()) == NULL)
+	return;
+    b = my_buf;
+    if (!claim_buf(b, BUF_OWNED))     /* closed by mmrecord_fini */
+	return;
+    b->ops[b->count] = op;
+    if (++b->count == RECORD_BUF)
+	flush_buf(b);
+    __atomic_store_n(&b->state, BUF_OWNED, __ATOMIC_RELEASE);
+}
+
+/* Returns a new sequence number */
+#define NEXT_SEQ() __atomic_fetch_add(&next_seq, 1, __ATOMIC_SEQ_CST)
+
+/* Is the calling thread to be recorded? */
+#define RECORDING() (out_fd >= 0 && !in_recorder)
+
+__attribute__((constructor))
+static void mmrecord_init(void)
+{
+    char *path = getenv("MMRECORD_FILE");
+    int fd;
+
+    if (path == NULL)
+	path = "mmrecord.raw";
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0 || write(fd, TRACE_RAW_MAGIC, 8) != 8) {
+	fprintf(stderr, "mmrecord: cannot write %s: %s\n", path,
+		strerror(errno));
+	return;
+    }
+    pthread_key_create(&buf_key, release_buf);
+    out_fd = fd;
+}
+
+/*
+ * Closes and flushes every buffer, including those of the threads still
+ * running: a buffer is claimed when its thread is not appending to it,
+ * and stays closed. The file is not closed, so that its descriptor is
+ * not reused while running threads may still be about to write to it.
+ */
+__attribute__((destructor))
+static void mmrecord_fini(void)
+{
+    record_buf_t *b;
+    int state;
+
+    if (out_fd < 0)
+	return;
+    for (b = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); b; b = b->next) {
+	while ((state = __atomic_load_n(&b->state, __ATOMIC_ACQUIRE))
+	       == BUF_BUSY || (state != BUF_CLOSED && !claim_buf(b, state)))
+	    sched_yield();
+	if (state == BUF_CLOSED)
+	    continue;
+	flush_buf(b);
+	__atomic_store_n(&b->state, BUF_CLOSED, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&out_fd, -1, __ATOMIC_RELEASE);
+}
+
+void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+
+    if (RECORDING() && p != NULL) {
+	in_recorder = 1;
+	record(NEXT_SEQ(), ALLOC, p, NULL, size);
+	in_recorder = 0;
+    }
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p = __libc_calloc(nmemb, size);
+
+    if (RECORDING() && p != NULL) {
+	in_recorder = 1;
+	record(NEXT_SEQ(), ALLOC, p, NULL, nmemb * size);
+	in_recorder = 0;
+    }
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    uint64_t seq;
+    void *p;
+
+    if (!RECORDING())
+	return __libc_realloc(ptr, size);
+
+    /* realloc(ptr, 0) frees ptr */
+    if (ptr != NULL && size == 0) {
+	in_recorder = 1;
+	record(NEXT_SEQ(), FREE, ptr, NULL, 0);
+	in_recorder = 0;
+	return __libc_realloc(ptr, size);
+    }
+
+    p = __libc_realloc(ptr, size);
+    if (p != NULL) {
+	in_recorder = 1;
+	seq = NEXT_SEQ();
+	record(seq, (ptr == NULL) ? ALLOC : REALLOC, p, ptr, size);
+	in_recorder = 0;
+    }
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (RECORDING() && ptr != NULL) {
+	in_recorder = 1;
+	record(NEXT_SEQ(), FREE, ptr, NULL, 0);
+	in_recorder = 0;
+    }
+    __libc_free(ptr);
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p = __libc_memalign(align, size);
+
+    if (RECORDING() && p != NULL) {
+	in_recorder = 1;
+	record(NEXT_SEQ(), ALLOC, p, NULL, size);
+	in_recorder = 0;
+    }
+    return p;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0)
+	return EINVAL;
+    if ((p = memalign(align, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
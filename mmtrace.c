@@ -0,0 +1,325 @@
+/*
+ * mmtrace.c - Convert malloc lab traces between the text (.rep) and
+ *             the binary format (see trace.h)
+ *
+ * The output is written in the format opposite to the input, unless
+ * the format is forced with -b or -t.
+ *
+ * With -r, the input is a raw recording of mmrecord.so instead: the
+ * records are sorted by sequence number, each block gets a new id, in
+ * the order of allocation, and the header is filled in (the suggested
+ * heap size is the peak of the live payload bytes). The output is text
+ * unless -b is given.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "trace.h"
+
+/* Initial number of entries of the address table of read_raw */
+#define ADDR_INIT_SIZE (1 << 16)
+
+/* Home entry of an address in the address table */
+#define ADDR_HASH(ptr, mask) \
+    ((size_t)(((ptr) >> 4) * 0x9e3779b97f4a7c15ull >> 32) & (mask))
+
+/* Ids of the live blocks of a recording, by address (linear probing) */
+typedef struct {
+    struct addr_entry {
+	uint64_t ptr;        /* 0 if the entry is empty */
+	int id;
+    } *entries;
+    size_t mask;             /* number of entries - 1 */
+    size_t count;            /* number of used entries */
+} addr_table_t;
+
+int verbose = 0;  /* read by stream_trace */
+
+static trace_t *read_raw(char *path);
+static int addr_find(addr_table_t *t, uint64_t ptr);
+static void addr_insert(addr_table_t *t, uint64_t ptr, int id);
+static void addr_remove(addr_table_t *t, uint64_t ptr);
+static void *xrealloc(void *p, size_t size);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c;
+    int binary = -1;  /* output format, -1 for the opposite of the input */
+    int raw = 0;
+    trace_t *trace;
+
+    while ((c = getopt(argc, argv, "bthvr")) != EOF) {
+	switch (c) {
+	case 'b': /* Write a binary trace */
+	    binary = 1;
+	    break;
+	case 't': /* Write a text trace */
+	    binary = 0;
+	    break;
+	case 'r': /* Convert a recording of mmrecord.so */
+	    raw = 1;
+	    break;
+	case 'v': /* Print the trace header */
+	    verbose = 1;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 2) {
+	usage();
+	exit(1);
+    }
+
+    /* Traces are streamed, so they may be larger than memory */
+    if (raw)
+	trace = read_raw(argv[optind]);
+    else
+	trace = stream_trace("", argv[optind]);
+    if (binary < 0)
+	binary = raw ? 0 : !trace->binary;
+    if (verbose)
+	printf("%s: %d ids, %d ops, written as %s to %s\n", argv[optind],
+	       trace->num_ids, trace->num_ops, binary ? "binary" : "text",
+	       argv[optind + 1]);
+    if (write_trace(trace, argv[optind + 1], binary) < 0) {
+	printf("Could not write %s: %s\n", argv[optind + 1], strerror(errno));
+	exit(1);
+    }
+    free_trace(trace);
+    return 0;
+}
+
+/*
+ * compare_seq - qsort order of raw records
+ */
+static int compare_seq(const void *a, const void *b)
+{
+    uint64_t x = ((const rawop_t *)a)->seq, y = ((const rawop_t *)b)->seq;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * read_raw - turn a recording of mmrecord.so into a trace held in memory.
+ *    Frees of blocks allocated before the recording started are dropped,
+ *    and so are requests too large for a trace. Requests of 0 bytes (whose
+ *    block must still be freed) become requests of 1 byte, since mdriver
+ *    only replays blocks with a payload. A realloc of an unknown block
+ *    becomes an allocation; an allocation at the address of a live block
+ *    (whose free was lost) frees that block first.
+ */
+static trace_t *read_raw(char *path)
+{
+    FILE *fp;
+    char magic[8];
+    rawop_t *raw = NULL;
+    size_t num_raw = 0, max_raw = 0, i;
+    trace_t *trace;
+    traceop_t *op;
+    addr_table_t addrs;
+    int *sizes = NULL;      /* payload size of each id */
+    int max_ids = 0, id, stale;
+    long live = 0, peak = 0;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+	printf("Could not open %s: %s\n", path, strerror(errno));
+	exit(1);
+    }
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+	memcmp(magic, TRACE_RAW_MAGIC, sizeof(magic)) != 0) {
+	printf("%s is not a recording of mmrecord.so\n", path);
+	exit(1);
+    }
+    do {
+	if (num_raw == max_raw) {
+	    max_raw = max_raw ? 2 * max_raw : 65536;
+	    raw = (rawop_t *)xrealloc(raw, max_raw * sizeof(rawop_t));
+	}
+	num_raw += fread(raw + num_raw, sizeof(rawop_t), max_raw - num_raw, fp);
+    } while (num_raw == max_raw);
+    fclose(fp);
+    qsort(raw, num_raw, sizeof(rawop_t), compare_seq);
+
+    if ((trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL ||
+	(addrs.entries = (struct addr_entry *)
+	 calloc(ADDR_INIT_SIZE, sizeof(struct addr_entry))) == NULL) {
+	printf("malloc failed in read_raw\n");
+	exit(1);
+    }
+    addrs.mask = ADDR_INIT_SIZE - 1;
+    addrs.count = 0;
+    /* A stale block may add a free: at most two requests per record */
+    trace->ops = (traceop_t *)xrealloc(NULL, (2 * num_raw + 1) *
+				       sizeof(traceop_t));
+
+    for (i = 0; i < num_raw; i++) {
+	rawop_t *r = &raw[i];
+
+	if (r->size > INT_MAX)
+	    continue;
+	if (r->size == 0 && r->type != FREE)
+	    r->size = 1;
+	if (r->type == FREE || r->type == REALLOC) {
+	    id = addr_find(&addrs, (r->type == FREE) ? r->ptr : r->old);
+	    if (id < 0 && r->type == FREE)
+		continue;
+	    if (id >= 0) {
+		addr_remove(&addrs, (r->type == FREE) ? r->ptr : r->old);
+		live -= sizes[id];
+		if (r->type == FREE) {
+		    op = &trace->ops[trace->num_ops++];
+		    op->type = FREE;
+		    op->index = id;
+		    op->size = 0;
+		    continue;
+		}
+	    }
+	}
+	else
+	    id = -1;
+
+	/* The block at this address is live: its free was lost */
+	if ((stale = addr_find(&addrs, r->ptr)) >= 0) {
+	    op = &trace->ops[trace->num_ops++];
+	    op->type = FREE;
+	    op->index = stale;
+	    op->size = 0;
+	    live -= sizes[stale];
+	    addr_remove(&addrs, r->ptr);
+	}
+
+	op = &trace->ops[trace->num_ops++];
+	if (id < 0) {
+	    if (trace->num_ids == max_ids) {
+		max_ids = max_ids ? 2 * max_ids : 65536;
+		sizes = (int *)xrealloc(sizes, max_ids * sizeof(int));
+	    }
+	    id = trace->num_ids++;
+	    op->type = ALLOC;
+	}
+	else
+	    op->type = REALLOC;
+	op->index = id;
+	op->size = sizes[id] = (int)r->size;
+	addr_insert(&addrs, r->ptr, id);
+	live += sizes[id];
+	if (live > peak)
+	    peak = live;
+    }
+
+    trace->sugg_heapsize = (peak > INT_MAX) ? INT_MAX : (int)peak;
+    trace->weight = 1;
+    trace->ops_base = 0;
+    trace->ops_end = trace->num_ops;
+    if (verbose)
+	printf("%s: %lu records, %lu blocks still live\n", path,
+	       (unsigned long)num_raw, (unsigned long)addrs.count);
+    free(addrs.entries);
+    free(sizes);
+    free(raw);
+    return trace;
+}
+
+/*
+ * addr_find - returns the id of the live block at ptr, or -1
+ */
+static int addr_find(addr_table_t *t, uint64_t ptr)
+{
+    size_t i;
+
+    for (i = ADDR_HASH(ptr, t->mask); t->entries[i].ptr != 0;
+	 i = (i + 1) & t->mask)
+	if (t->entries[i].ptr == ptr)
+	    return t->entries[i].id;
+    return -1;
+}
+
+/*
+ * addr_insert - add a block that is not in the table, which is doubled
+ *    when it is half full
+ */
+static void addr_insert(addr_table_t *t, uint64_t ptr, int id)
+{
+    struct addr_entry *old = t->entries;
+    size_t i, size = t->mask + 1;
+
+    if (2 * (t->count + 1) > size) {
+	if ((t->entries = (struct addr_entry *)
+	     calloc(2 * size, sizeof(struct addr_entry))) == NULL) {
+	    printf("malloc failed in addr_insert\n");
+	    exit(1);
+	}
+	t->mask = 2 * size - 1;
+	t->count = 0;
+	for (i = 0; i < size; i++)
+	    if (old[i].ptr != 0)
+		addr_insert(t, old[i].ptr, old[i].id);
+	free(old);
+    }
+    for (i = ADDR_HASH(ptr, t->mask); t->entries[i].ptr != 0;
+	 i = (i + 1) & t->mask)
+	;
+    t->entries[i].ptr = ptr;
+    t->entries[i].id = id;
+    t->count++;
+}
+
+/*
+ * addr_remove - remove a block from the table, shifting back the entries
+ *    that follow it so that no lookup stops early
+ */
+static void addr_remove(addr_table_t *t, uint64_t ptr)
+{
+    size_t i, j, home;
+
+    for (i = ADDR_HASH(ptr, t->mask); t->entries[i].ptr != ptr;
+	 i = (i + 1) & t->mask)
+	if (t->entries[i].ptr == 0)
+	    return;
+    for (j = (i + 1) & t->mask; t->entries[j].ptr != 0;
+	 j = (j + 1) & t->mask) {
+	home = ADDR_HASH(t->entries[j].ptr, t->mask);
+	if (((j - home) & t->mask) >= ((j - i) & t->mask)) {
+	    t->entries[i] = t->entries[j];
+	    i = j;
+	}
+    }
+    t->entries[i].ptr = 0;
+    t->count--;
+}
+
+/*
+ * xrealloc - realloc that exits on failure
+ */
+static void *xrealloc(void *p, size_t size)
+{
+    if ((p = realloc(p, size)) == NULL) {
+	printf("malloc failed in read_raw\n");
+	exit(1);
+    }
+    return p;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmtrace [-hvbtr] <in> <out>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b   Write a binary trace.\n");
+    fprintf(stderr, "\t-t   Write a text trace.\n");
+    fprintf(stderr, "\t-h   Print this message.\n");
+    fprintf(stderr, "\t-r   Convert a recording of mmrecord.so.\n");
+    fprintf(stderr, "\t-v   Print what is converted.\n");
+}
@@ -0,0 +1,118 @@
+/*
+ * perfctr.c - Count hardware events during a function f
+ *
+ * Uses the perf_event_open system call of Linux. Every event has a
+ * counter of its own rather than a group, so that the events the CPU
+ * or the kernel (perf_event_paranoid, virtual machines) refuses don't
+ * take the others down. The counters are opened on the first call in
+ * every process, since the counters of a parent don't follow a fork.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+const char *pc_names[PC_NB_EVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", 
+    "branch_misses", "dtlb_misses"
+};
+
+#ifdef __linux__
+
+/* Generic cache event: read misses of a cache */
+#define CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+				| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* Type and config of the events, in the order of the PC_xxx constants */
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} events[PC_NB_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+static int fds[PC_NB_EVENTS];  /* counters, -1 if not available */
+static pid_t owner = -1;       /* process that opened the counters */
+
+/*
+ * open_counters - open a disabled counter of the calling process for
+ *    every event
+ */
+static void open_counters(void)
+{
+    struct perf_event_attr attr;
+    int e;
+
+    for (e = 0; e < PC_NB_EVENTS; e++) {
+	if (owner != -1 && fds[e] >= 0)
+	    close(fds[e]);
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[e].type;
+	attr.config = events[e].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | 
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    owner = getpid();
+}
+
+/* 
+ * pc_measure - Count the events during f(argp) 
+ */
+int pc_measure(pc_test_funct f, void *argp, double *counts)
+{
+    unsigned long long val[3];  /* count, time enabled, time running */
+    int e, n = 0;
+
+    if (owner != getpid())
+	open_counters();
+
+    for (e = 0; e < PC_NB_EVENTS; e++)
+	if (fds[e] >= 0) {
+	    ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    f(argp);
+    for (e = 0; e < PC_NB_EVENTS; e++)
+	if (fds[e] >= 0)
+	    ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (e = 0; e < PC_NB_EVENTS; e++) {
+	counts[e] = -1;
+	if (fds[e] < 0 || read(fds[e], val, sizeof(val)) != sizeof(val) ||
+	    val[2] == 0)
+	    continue;
+	counts[e] = (double)val[0] * ((double)val[1] / (double)val[2]);
+	n++;
+    }
+    return n;
+}
+
+#else /* !__linux__ */
+
+int pc_measure(pc_test_funct f, void *argp, double *counts)
+{
+    int e;
+
+    f(argp);
+    for (e = 0; e < PC_NB_EVENTS; e++)
+	counts[e] = -1;
+    return 0;
+}
+
+#endif
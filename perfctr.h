@@ -0,0 +1,22 @@
+/* 
+ * Hardware performance counters 
+ */
+typedef void (*pc_test_funct)(void *);
+
+/* Events counted by pc_measure */
+#define PC_CYCLES        0  /* CPU cycles */
+#define PC_INSTRUCTIONS  1  /* retired instructions */
+#define PC_L1D_MISSES    2  /* L1 data cache read misses */
+#define PC_LLC_MISSES    3  /* last level cache misses */
+#define PC_BRANCH_MISSES 4  /* mispredicted branches */
+#define PC_DTLB_MISSES   5  /* data TLB read misses */
+#define PC_NB_EVENTS     6
+
+/* Names of the events, for result files */
+extern const char *pc_names[PC_NB_EVENTS];
+
+/* Count the events of the calling process (user mode) while f(argp)
+   runs. counts[e] is the count of event e, scaled up if the kernel
+   multiplexed its counter, or -1 if the event is not available.
+   Returns the number of available events (0 without perf_event_open). */
+int pc_measure(pc_test_funct f, void *argp, double *counts);
@@ -0,0 +1,591 @@
+/*
+ * trace.c - Read and write malloc lab traces, in text or binary form
+ *
+ * Text traces are parsed into a malloc'ed array of requests. Binary
+ * traces are mapped read-only, and their records are used as the
+ * request array without any copy, after a single validation pass.
+ * Streamed traces (either format) are decoded chunk by chunk by a
+ * reader thread, see trace.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+/* Initial number of entries of a block hash table */
+#define HASH_INIT_SIZE (1 << 16)
+
+/* Home entry of an id in a block hash table */
+#define HASH(id, mask) (((uint32_t)(id) * 2654435761u) & (mask))
+
+/* Double-buffered reader of a streamed trace */
+struct trace_stream {
+    FILE *fp;                /* trace file... */
+    char path[MAXLINE];      /* ... its path... */
+    int binary;              /* ... its format... */
+    long data_start;         /* ... and the offset of its first request */
+    int num_ids;             /* copied from the trace_t */
+    int num_ops;
+    traceop_t *buf[2];       /* buffers of TRACE_CHUNK requests... */
+    int count[2];            /* ... and their number of requests, -1 if
+				the buffer waits for the reader */
+    int cur;                 /* buffer being replayed */
+    int running;             /* is the reader thread started? */
+    int stop;                /* asks the reader thread to exit */
+    pthread_t reader;
+    pthread_mutex_t lock;    /* protects count and stop */
+    pthread_cond_t cond;     /* signals changes of count and stop */
+};
+
+/* Hash table of the payloads of the live ids (linear probing) */
+struct block_hash {
+    struct block_entry {
+	int32_t id;          /* -1 if the entry is empty */
+	block_t block;
+    } *entries;
+    size_t mask;             /* number of entries - 1 */
+    size_t count;            /* number of used entries */
+};
+
+extern int verbose;
+
+static trace_t *open_trace(char *tracedir, char *filename, FILE **fp,
+			   char *path);
+static int read_header(trace_t *trace, FILE *fp, char *path);
+static void map_trace(trace_t *trace, FILE *fp, char *path);
+static void parse_trace(trace_t *trace, FILE *fp, char *path);
+static int read_text_op(FILE *fp, traceop_t *op, char *path);
+static void check_op(traceop_t *op, int i, int num_ids, char *path);
+static void alloc_blocks(trace_t *trace);
+static void *stream_reader(void *arg);
+static void start_reader(struct trace_stream *s);
+static void stop_reader(struct trace_stream *s);
+static void unix_error(char *msg);
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char path[MAXLINE];
+
+    trace = open_trace(tracedir, filename, &tracefile, path);
+
+    /* Binary traces are mapped, text traces are parsed */
+    trace->binary = read_header(trace, tracefile, path);
+    if (trace->binary)
+	map_trace(trace, tracefile, path);
+    else
+	parse_trace(trace, tracefile, path);
+    fclose(tracefile);
+
+    trace->ops_base = 0;
+    trace->ops_end = trace->num_ops;
+    alloc_blocks(trace);
+    return trace;
+}
+
+/*
+ * stream_trace - open a trace file for a streamed replay: only its
+ *    header is read here, the requests are decoded by the reader thread
+ *    as the replay goes (see trace_seek)
+ */
+trace_t *stream_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    struct trace_stream *s;
+    char path[MAXLINE];
+
+    trace = open_trace(tracedir, filename, &tracefile, path);
+
+    if ((s = (struct trace_stream *)calloc(1, sizeof(*s))) == NULL ||
+	(s->buf[0] = (traceop_t *)
+	 malloc(TRACE_CHUNK * sizeof(traceop_t))) == NULL ||
+	(s->buf[1] = (traceop_t *)
+	 malloc(TRACE_CHUNK * sizeof(traceop_t))) == NULL)
+	unix_error("malloc failed in stream_trace");
+    s->fp = tracefile;
+    strcpy(s->path, path);
+    s->binary = trace->binary = read_header(trace, tracefile, path);
+    s->data_start = ftell(tracefile);
+    s->num_ids = trace->num_ids;
+    s->num_ops = trace->num_ops;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    /* No request is loaded, so the first trace_op starts the reader */
+    trace->stream = s;
+    trace->ops = NULL;
+    trace->ops_base = trace->ops_end = 0;
+    alloc_blocks(trace);
+    return trace;
+}
+
+/*
+ * open_trace - allocate the trace record and open the trace file
+ */
+static trace_t *open_trace(char *tracedir, char *filename, FILE **fp,
+			   char *path)
+{
+    trace_t *trace;
+    char msg[2*MAXLINE];
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) calloc(1, sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trace");
+
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((*fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	unix_error(msg);
+    }
+    return trace;
+}
+
+/*
+ * read_header - read the header of a trace file, leaving the file at
+ *    the first request. Returns 1 for a binary trace, 0 for a text one.
+ */
+static int read_header(trace_t *trace, FILE *fp, char *path)
+{
+    trace_header_t hdr;
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0) {
+	rewind(fp);
+	fscanf(fp, "%d", &(trace->sugg_heapsize)); /* not used */
+	fscanf(fp, "%d", &(trace->num_ids));
+	fscanf(fp, "%d", &(trace->num_ops));
+	fscanf(fp, "%d", &(trace->weight));        /* not used */
+	return 0;
+    }
+
+    if (hdr.byte_order != TRACE_BYTE_ORDER) {
+	printf("Tracefile %s has a foreign byte order\n", path);
+	exit(1);
+    }
+    if (hdr.num_ops < 0 || hdr.num_ids < 0) {
+	printf("Tracefile %s is corrupted\n", path);
+	exit(1);
+    }
+    trace->sugg_heapsize = hdr.sugg_heapsize;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;
+    return 1;
+}
+
+/*
+ * map_trace - map a binary trace and use its records as the request array
+ */
+static void map_trace(trace_t *trace, FILE *fp, char *path)
+{
+    struct stat st;
+    char msg[2*MAXLINE];
+    int i;
+
+    if (fstat(fileno(fp), &st) < 0) {
+	sprintf(msg, "Could not stat %s in read_trace", path);
+	unix_error(msg);
+    }
+    if ((size_t)st.st_size !=
+	sizeof(trace_header_t) + trace->num_ops * sizeof(traceop_t)) {
+	printf("Tracefile %s is truncated or corrupted\n", path);
+	exit(1);
+    }
+
+    trace->map_size = st.st_size;
+    trace->map = mmap(NULL, trace->map_size, PROT_READ, MAP_PRIVATE,
+		      fileno(fp), 0);
+    if (trace->map == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in read_trace", path);
+	unix_error(msg);
+    }
+    madvise(trace->map, trace->map_size, MADV_SEQUENTIAL);
+    trace->ops = (traceop_t *)((char *)trace->map + sizeof(trace_header_t));
+
+    /* The driver trusts the requests, so check them once */
+    for (i = 0; i < trace->num_ops; i++)
+	check_op(&trace->ops[i], i, trace->num_ids, path);
+}
+
+/*
+ * parse_trace - read the requests of a text trace
+ */
+static void parse_trace(trace_t *trace, FILE *fp, char *path)
+{
+    int max_index = 0;
+    int op_index;
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in read_trace");
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    while (op_index < trace->num_ops &&
+	   read_text_op(fp, &trace->ops[op_index], path)) {
+	if (trace->ops[op_index].index > max_index)
+	    max_index = trace->ops[op_index].index;
+	op_index++;
+    }
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+}
+
+/*
+ * read_text_op - decode the next request line of a text trace. Returns 0
+ *    at the end of the file.
+ */
+static int read_text_op(FILE *fp, traceop_t *op, char *path)
+{
+    char type[MAXLINE];
+    unsigned index, size = 0;
+
+    if (fscanf(fp, "%s", type) == EOF)
+	return 0;
+
+    switch(type[0]) {
+    case 'a':
+	fscanf(fp, "%u %u", &index, &size);
+	op->type = ALLOC;
+	break;
+    case 'r':
+	fscanf(fp, "%u %u", &index, &size);
+	op->type = REALLOC;
+	break;
+    case 'f':
+	fscanf(fp, "%ud", &index);
+	op->type = FREE;
+	break;
+    default:
+	printf("Bogus type character (%c) in tracefile %s\n",
+	       type[0], path);
+	exit(1);
+    }
+    op->index = index;
+    op->size = size;
+    return 1;
+}
+
+/*
+ * check_op - exit if request i does not make sense
+ */
+static void check_op(traceop_t *op, int i, int num_ids, char *path)
+{
+    if (op->type < ALLOC || op->type > REALLOC ||
+	op->index < 0 || op->index >= num_ids ||
+	(op->type != FREE && op->size < 0)) {
+	printf("Bogus request %d in tracefile %s\n", i, path);
+	exit(1);
+    }
+}
+
+/*
+ * alloc_blocks - allocate the array of payloads, or the hash table that
+ *    replaces it when there are too many ids
+ */
+static void alloc_blocks(trace_t *trace)
+{
+    struct block_hash *h;
+    size_t i;
+
+    if (trace->num_ids <= TRACE_DIRECT_IDS) {
+	if ((trace->blocks =
+	     (block_t *)malloc(trace->num_ids * sizeof(block_t))) == NULL)
+	    unix_error("malloc 3 failed in read_trace");
+	return;
+    }
+
+    if ((h = (struct block_hash *)malloc(sizeof(*h))) == NULL ||
+	(h->entries = (struct block_entry *)
+	 malloc(HASH_INIT_SIZE * sizeof(struct block_entry))) == NULL)
+	unix_error("malloc 4 failed in read_trace");
+    for (i = 0; i < HASH_INIT_SIZE; i++)
+	h->entries[i].id = -1;
+    h->mask = HASH_INIT_SIZE - 1;
+    h->count = 0;
+    trace->hash = h;
+}
+
+/*
+ * trace_hashed_block - find the payload of an id in the hash table, or
+ *    add it. The table doubles when it gets half full.
+ */
+block_t *trace_hashed_block(trace_t *trace, int index)
+{
+    struct block_hash *h = trace->hash;
+    struct block_entry *old;
+    size_t i, size;
+
+    for (i = HASH(index, h->mask); h->entries[i].id != -1;
+	 i = (i + 1) & h->mask)
+	if (h->entries[i].id == index)
+	    return &h->entries[i].block;
+
+    if (2 * (h->count + 1) > h->mask + 1) {
+	old = h->entries;
+	size = h->mask + 1;
+	if ((h->entries = (struct block_entry *)
+	     malloc(2 * size * sizeof(struct block_entry))) == NULL)
+	    unix_error("malloc failed in trace_hashed_block");
+	h->mask = 2 * size - 1;
+	for (i = 0; i <= h->mask; i++)
+	    h->entries[i].id = -1;
+	h->count = 0;
+	for (i = 0; i < size; i++)
+	    if (old[i].id != -1)
+		*trace_hashed_block(trace, old[i].id) = old[i].block;
+	free(old);
+	return trace_hashed_block(trace, index);
+    }
+
+    h->entries[i].id = index;
+    h->entries[i].block.ptr = NULL;
+    h->entries[i].block.size = 0;
+    h->count++;
+    return &h->entries[i].block;
+}
+
+/*
+ * trace_unhash_block - remove an id from the hash table, shifting back
+ *    the entries that were displaced by it
+ */
+void trace_unhash_block(trace_t *trace, int index)
+{
+    struct block_hash *h = trace->hash;
+    size_t i, j, k;
+
+    for (i = HASH(index, h->mask); h->entries[i].id != index;
+	 i = (i + 1) & h->mask)
+	if (h->entries[i].id == -1)
+	    return;
+
+    for (j = (i + 1) & h->mask; h->entries[j].id != -1; j = (j + 1) & h->mask) {
+	/* entry j may move to i if its home is not in (i, j] */
+	k = HASH(h->entries[j].id, h->mask);
+	if ((i < j) ? (k <= i || k > j) : (k <= i && k > j)) {
+	    h->entries[i] = h->entries[j];
+	    i = j;
+	}
+    }
+    h->entries[i].id = -1;
+    h->count--;
+}
+
+/*
+ * trace_seek - make request i available in trace->ops. A loaded trace
+ *    has all of them; a streamed one moves to its next chunk if i is the
+ *    first request after the current one, and restarts from the
+ *    beginning of the file if i is 0.
+ */
+void trace_seek(trace_t *trace, int i)
+{
+    struct trace_stream *s = trace->stream;
+    int b;
+
+    if (s == NULL || i >= trace->num_ops || (i != 0 && i != trace->ops_end)) {
+	printf("Request %d of the trace is out of order\n", i);
+	exit(1);
+    }
+
+    if (i == 0) {
+	stop_reader(s);
+	start_reader(s);
+	b = 0;
+    }
+    else {
+	/* give the current buffer back to the reader */
+	pthread_mutex_lock(&s->lock);
+	s->count[s->cur] = -1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	b = s->cur ^ 1;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    while (s->count[b] < 0)
+	pthread_cond_wait(&s->cond, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+
+    s->cur = b;
+    trace->ops = s->buf[b];
+    trace->ops_base = i;
+    trace->ops_end = i + s->count[b];
+}
+
+/*
+ * stream_reader - body of the reader thread: decode the requests chunk
+ *    by chunk, alternating between the two buffers
+ */
+static void *stream_reader(void *arg)
+{
+    struct trace_stream *s = (struct trace_stream *)arg;
+    int b = 0;
+    int first = 0;
+    int i, n;
+
+    pthread_mutex_lock(&s->lock);
+    while (first < s->num_ops) {
+	while (s->count[b] >= 0 && !s->stop)
+	    pthread_cond_wait(&s->cond, &s->lock);
+	if (s->stop)
+	    break;
+	pthread_mutex_unlock(&s->lock);
+
+	n = (s->num_ops - first < TRACE_CHUNK) ? s->num_ops - first : TRACE_CHUNK;
+	if (s->binary) {
+	    if (fread(s->buf[b], sizeof(traceop_t), n, s->fp) != (size_t)n) {
+		printf("Tracefile %s is truncated\n", s->path);
+		exit(1);
+	    }
+	}
+	else {
+	    for (i = 0; i < n; i++)
+		if (!read_text_op(s->fp, &s->buf[b][i], s->path)) {
+		    printf("Tracefile %s is truncated\n", s->path);
+		    exit(1);
+		}
+	}
+	for (i = 0; i < n; i++)
+	    check_op(&s->buf[b][i], first + i, s->num_ids, s->path);
+
+	pthread_mutex_lock(&s->lock);
+	s->count[b] = n;
+	pthread_cond_broadcast(&s->cond);
+	first += n;
+	b ^= 1;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/*
+ * start_reader - start a reader thread at the first request of the file
+ */
+static void start_reader(struct trace_stream *s)
+{
+    fseek(s->fp, s->data_start, SEEK_SET);
+    s->count[0] = s->count[1] = -1;
+    s->stop = 0;
+    if ((errno = pthread_create(&s->reader, NULL, stream_reader, s)) != 0)
+	unix_error("pthread_create failed in trace_seek");
+    s->running = 1;
+}
+
+/*
+ * stop_reader - stop the reader thread, if any
+ */
+static void stop_reader(struct trace_stream *s)
+{
+    if (!s->running)
+	return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+    s->running = 0;
+}
+
+/*
+ * free_trace - Free the trace record and everything it points to, all
+ *              of which were allocated in read_trace() or stream_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    struct trace_stream *s = trace->stream;
+
+    if (s != NULL) {           /* stop the stream, or unmap or free... */
+	stop_reader(s);
+	fclose(s->fp);
+	free(s->buf[0]);
+	free(s->buf[1]);
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	free(s);
+    }
+    else if (trace->map != NULL)
+	munmap(trace->map, trace->map_size);
+    else
+	free(trace->ops);      /* ... the requests */
+    if (trace->hash != NULL) { /* the payload records... */
+	free(trace->hash->entries);
+	free(trace->hash);
+    }
+    free(trace->blocks);
+    free(trace->death_phases);  /* (only set for the arena replay) */
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * write_trace - write the header and the requests of a trace to path,
+ *    as text or binary
+ */
+int write_trace(trace_t *trace, char *path, int binary)
+{
+    FILE *fp;
+    trace_header_t hdr;
+    traceop_t *op;
+    int i;
+
+    if ((fp = fopen(path, binary ? "wb" : "w")) == NULL)
+	return -1;
+
+    if (binary) {
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = TRACE_BYTE_ORDER;
+	hdr.sugg_heapsize = trace->sugg_heapsize;
+	hdr.num_ids = trace->num_ids;
+	hdr.num_ops = trace->num_ops;
+	hdr.weight = trace->weight;
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+    }
+    else
+	fprintf(fp, "%d\n%d\n%d\n%d\n", trace->sugg_heapsize,
+		trace->num_ids, trace->num_ops, trace->weight);
+
+    for (i = 0; i < trace->num_ops; i++) {
+	op = trace_op(trace, i);
+	if (binary)
+	    fwrite(op, sizeof(traceop_t), 1, fp);
+	else if (op->type == FREE)
+	    fprintf(fp, "f %d\n", op->index);
+	else
+	    fprintf(fp, "%c %d %d\n", (op->type == ALLOC) ? 'a' : 'r',
+		    op->index, op->size);
+    }
+
+    if (ferror(fp)) {
+	fclose(fp);
+	return -1;
+    }
+    return fclose(fp);
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
@@ -0,0 +1,131 @@
+/*
+ * trace.h - Malloc lab traces
+ *
+ * A trace is either a text file (.rep: four header lines, then one
+ * request per line) or a binary file: a trace_header_t followed by
+ * num_ops traceop_t records, which read_trace maps in memory and uses
+ * in place. read_trace recognizes the format by the magic number;
+ * the mmtrace tool converts between the two.
+ *
+ * Traces that do not fit in memory can be opened with stream_trace
+ * instead: a reader thread then decodes the requests TRACE_CHUNK at a
+ * time into two buffers, filling one while the driver replays the
+ * other. The requests must be accessed with trace_op, in order (going
+ * back to request 0 rewinds the stream), and the payloads with
+ * trace_block, which uses a hash table of the live ids instead of an
+ * array when there are more than TRACE_DIRECT_IDS ids.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_CHUNK      65536      /* requests per buffer of a stream */
+#define TRACE_DIRECT_IDS (1 << 22)  /* more ids are hashed */
+
+/* Types of requests */
+enum {ALLOC, FREE, REALLOC};
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    int32_t type;                     /* type of request */
+    int32_t index;                    /* index for free() to use later */
+    int32_t size;                     /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Header of a binary trace file */
+#define TRACE_MAGIC      "MMTRACE1"
+#define TRACE_BYTE_ORDER 0x01020304   /* as written by the host */
+
+typedef struct {
+    char magic[8];           /* TRACE_MAGIC, without the final '\0' */
+    uint32_t byte_order;     /* TRACE_BYTE_ORDER */
+    int32_t sugg_heapsize;   /* same fields as in trace_t */
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t weight;
+    int32_t reserved;        /* 0, pads the header to 32 bytes */
+} trace_header_t;
+
+/* Payload of the block of an id */
+typedef struct {
+    char *ptr;               /* pointer returned by malloc/realloc... */
+    size_t size;             /* ... and payload size */
+} block_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    int binary;          /* is the trace file in the binary format? */
+    traceop_t *ops;      /* array of requests (see trace_op) */
+    int ops_base;        /* number of the first request in ops... */
+    int ops_end;         /* ... and of the first one after them */
+    block_t *blocks;     /* payloads, indexed by id (see trace_block) */
+    int phase_len;       /* number of ops per phase of the arena replay... */
+    int num_phases;      /* ... number of phases ... */
+    int *death_phases;   /* ... and phase in which the block of each op dies */
+    void *map;           /* mapped binary trace file (NULL for text)... */
+    size_t map_size;     /* ... and its size */
+    struct trace_stream *stream;  /* reader of a streamed trace, or NULL */
+    struct block_hash *hash;      /* payloads when blocks is NULL */
+} trace_t;
+
+trace_t *read_trace(char *tracedir, char *filename);
+trace_t *stream_trace(char *tracedir, char *filename);
+void free_trace(trace_t *trace);
+
+/* Slow paths of trace_op and trace_block */
+void trace_seek(trace_t *trace, int i);
+block_t *trace_hashed_block(trace_t *trace, int index);
+void trace_unhash_block(trace_t *trace, int index);
+
+/*
+ * trace_op - returns request i. A streamed trace moves to the next chunk
+ *    when i is its first request, and rewinds when i is 0.
+ */
+static inline traceop_t *trace_op(trace_t *trace, int i)
+{
+    if (i < trace->ops_base || i >= trace->ops_end)
+	trace_seek(trace, i);
+    return &trace->ops[i - trace->ops_base];
+}
+
+/*
+ * trace_block - returns the payload record of an id. Hashed records are
+ *    created on first use, and removed by trace_drop_block.
+ */
+static inline block_t *trace_block(trace_t *trace, int index)
+{
+    if (trace->blocks != NULL)
+	return &trace->blocks[index];
+    return trace_hashed_block(trace, index);
+}
+
+/*
+ * trace_drop_block - forget the payload of an id once it is freed
+ */
+static inline void trace_drop_block(trace_t *trace, int index)
+{
+    if (trace->blocks == NULL)
+	trace_unhash_block(trace, index);
+}
+
+/*
+ * Raw recording of a real program (see mmrecord.c): TRACE_RAW_MAGIC
+ * followed by rawop_t records in no particular order. "mmtrace -r"
+ * sorts them, numbers the blocks and writes a trace.
+ */
+#define TRACE_RAW_MAGIC  "MMRAW001"
+
+typedef struct {
+    uint64_t seq;            /* global order of the request */
+    uint64_t ptr;            /* block returned by malloc/realloc, or freed */
+    uint64_t old;            /* block passed to realloc */
+    uint64_t size;           /* byte size of alloc/realloc request */
+    uint32_t type;           /* ALLOC, FREE or REALLOC */
+    uint32_t reserved;
+} rawop_t;
+
+/* Writes the requests of a trace as text or binary, returns -1 on error */
+int write_trace(trace_t *trace, char *path, int binary);